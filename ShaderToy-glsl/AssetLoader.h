@@ -0,0 +1,161 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include "Model.h"
+#include "ThreadPool.h"
+
+struct AssetLoaderStats
+{
+	unsigned int requested = 0;
+	unsigned int uploaded = 0;
+	unsigned int failed = 0;
+	unsigned int from_cache = 0;
+	double import_ms = 0.0;			// summed over the workers
+	double upload_ms = 0.0;			// on the GL thread
+};
+
+// Loads models in the background. Worker threads run Model::prepare(), i.e.
+// the Assimp import or the mesh cache lookup, and hand the results to the
+// GL thread through a small bounded queue. The GL thread calls upload()
+// once per frame to create the buffers of whatever has arrived, so drawing
+// goes on while assets stream in; Model::ready() tells which have arrived.
+// A worker whose result finds the queue full waits, which bounds the
+// imported meshes held in memory to the queue length plus one per worker.
+class AssetLoader
+{
+public:
+	// threads == 0 picks one per hardware thread.
+	explicit AssetLoader(unsigned int threads = 0, size_t max_pending_uploads = 4)
+		: _max_ready(max_pending_uploads > 0 ? max_pending_uploads : 1)
+	{
+		// requests queue without limit: load() is called from the GL thread,
+		// which must never block behind workers waiting for it to upload
+		_pool.reset(new ThreadPool(threads, (size_t)-1));
+	}
+
+	~AssetLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_cancel = true;
+		}
+		_space.notify_all();
+		_pool.reset();
+	}
+
+	// Queue model for loading; see Model::init() for the flags. model must
+	// stay alive and untouched until it is ready or the loader is gone.
+	void load(Model& model, const std::string& path, bool use_normal = true, bool use_uv = true, bool use_tangent = false, bool use_bitangent = false)
+	{
+		_stats.requested++;
+		Model* target = &model;
+		_pool->submit([this, target, path, use_normal, use_uv, use_tangent, use_bitangent]{
+			if (_cancel)
+				return;
+			std::unique_ptr<Result> result(new Result());
+			result->model = target;
+			auto start = std::chrono::high_resolution_clock::now();
+			result->ok = target->prepare(path, result->import, use_normal, use_uv, use_tangent, use_bitangent);
+			result->prepare_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::unique_lock<std::mutex> lock(_mutex);
+			_space.wait(lock, [this]{ return _cancel || _ready.size() < _max_ready; });
+			if (_cancel)
+				return;
+			_ready.push_back(std::move(result));
+			_arrived.notify_one();
+		});
+	}
+
+	// Upload up to max_uploads finished models. Call on the GL thread; returns
+	// how many became ready.
+	int upload(int max_uploads = 1 << 30)
+	{
+		int uploaded = 0;
+		while (uploaded < max_uploads){
+			std::unique_ptr<Result> result;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (_ready.empty())
+					break;
+				result = std::move(_ready.front());
+				_ready.pop_front();
+			}
+			_space.notify_one();
+			_stats.import_ms += result->prepare_ms;
+			if (!result->ok){
+				_stats.failed++;
+				continue;
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			result->model->upload(result->import);
+			_stats.upload_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			_stats.uploaded++;
+			if (result->import.from_cache)
+				_stats.from_cache++;
+			uploaded++;
+		}
+		return uploaded;
+	}
+
+	// Upload everything requested so far, blocking until it has arrived.
+	void finish()
+	{
+		while (pending() > 0){
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_arrived.wait(lock, [this]{ return !_ready.empty(); });
+			}
+			upload();
+		}
+	}
+
+	// Requested models that are neither ready nor failed.
+	unsigned int pending() const
+	{
+		return _stats.requested - _stats.uploaded - _stats.failed;
+	}
+
+	const AssetLoaderStats& stats() const
+	{
+		return _stats;
+	}
+
+	size_t threads() const
+	{
+		return _pool->size();
+	}
+
+	void print_stats() const
+	{
+		printf("asset loader: %u loaded (%u from mesh cache), %u failed, %.1f ms import on %u threads, %.1f ms upload\n",
+			_stats.uploaded, _stats.from_cache, _stats.failed, _stats.import_ms, (unsigned int)_pool->size(), _stats.upload_ms);
+	}
+
+private:
+	struct Result
+	{
+		Model* model = NULL;
+		MeshImport import;
+		bool ok = false;
+		double prepare_ms = 0.0;
+	};
+
+	std::unique_ptr<ThreadPool> _pool;
+	std::deque<std::unique_ptr<Result>> _ready;
+	size_t _max_ready;
+	std::mutex _mutex;
+	std::condition_variable _space;
+	std::condition_variable _arrived;
+	std::atomic<bool> _cancel{ false };
+	AssetLoaderStats _stats;
+};
+
+#endif
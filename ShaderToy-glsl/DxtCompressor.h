@@ -0,0 +1,359 @@
+#ifndef DXT_COMPRESSOR_H
+#define DXT_COMPRESSOR_H
+
+#include <emmintrin.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string.h>
+#include "ThreadPool.h"
+
+enum DxtFormat { DXT1, DXT5 };
+
+// DXT1/DXT5 block compression producing the same bytes as SOIL's
+// convert_image_to_DXT1()/convert_image_to_DXT5() (image_DXT.c), only
+// faster. SOIL fits each 4x4 block's colors to a line with a few power
+// iterations on the covariance matrix and quantizes along it, one block at a
+// time. Here the SSE2 lanes hold four blocks, so every lane goes through the
+// same float operations in the same order as SOIL's scalar code, which keeps
+// the output bit for bit identical while doing four blocks per instruction.
+// Rows of blocks are shared out over a thread pool, and the calling thread
+// works too.
+class DxtCompressor
+{
+public:
+	// threads == 0 picks one per hardware thread; 1 compresses on the
+	// calling thread only.
+	explicit DxtCompressor(unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		if (threads > 1)
+			_pool.reset(new ThreadPool(threads - 1, (size_t)-1));
+	}
+
+	// Shared by everything that compresses textures.
+	static DxtCompressor& instance()
+	{
+		static DxtCompressor compressor;
+		return compressor;
+	}
+
+	static size_t compressed_size(int width, int height, DxtFormat format)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * (format == DXT1 ? 8 : 16);
+	}
+
+	// Compress width x height pixels of 1 to 4 interleaved 8-bit channels
+	// (gray, gray+alpha, RGB, RGBA, as SOIL takes them) into out, which must
+	// hold compressed_size() bytes. Blocks are stored row by row from the
+	// first row of pixels.
+	void compress(const unsigned char* pixels, int width, int height, int channels, DxtFormat format, unsigned char* out)
+	{
+		if (width < 1 || height < 1 || channels < 1 || channels > 4)
+			return;
+		Job job;
+		job.pixels = pixels;
+		job.width = width;
+		job.height = height;
+		job.channels = channels;
+		job.format = format;
+		job.out = out;
+		// a few bands per thread balance uneven rows without much overhead
+		parallel_bands(_pool.get(), (height + 3) / 4, (int)threads() * 4, [&job](int first, int last){
+			for (int row = first; row < last; row++)
+				_CompressRow(job, row);
+		});
+	}
+
+	std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels, DxtFormat format)
+	{
+		std::vector<unsigned char> out(compressed_size(width, height, format));
+		compress(pixels, width, height, channels, format, &out[0]);
+		return out;
+	}
+
+	size_t threads() const
+	{
+		return _pool ? _pool->size() + 1 : 1;
+	}
+
+private:
+	struct Job
+	{
+		const unsigned char* pixels = NULL;
+		int width = 0;
+		int height = 0;
+		int channels = 4;
+		DxtFormat format = DXT1;
+		unsigned char* out = NULL;
+	};
+
+	static void _CompressRow(const Job& job, int block_row)
+	{
+		int blocks = (job.width + 3) / 4;
+		size_t block_size = job.format == DXT1 ? 8 : 16;
+		unsigned char* out = job.out + (size_t)block_row * blocks * block_size;
+		unsigned char gathered[4][64];
+		unsigned char encoded[4][16];
+		for (int b = 0; b < blocks; b += 4){
+			int count = std::min(4, blocks - b);
+			for (int k = 0; k < 4; k++)
+				_GatherBlock(job, b + std::min(k, count - 1), block_row, gathered[k]);
+			_EncodeColor(gathered, encoded);
+			if (job.format == DXT5)
+				_EncodeAlpha(gathered, encoded);
+			for (int k = 0; k < count; k++){
+				if (job.format == DXT5){
+					memcpy(out, encoded[k] + 8, 8);
+					memcpy(out + 8, encoded[k], 8);
+				}
+				else
+					memcpy(out, encoded[k], 8);
+				out += block_size;
+			}
+		}
+	}
+
+	// The block's 16 pixels as RGBA. As in SOIL, 1 and 2 channels are gray,
+	// missing alpha is 255, and pixels past the image edge repeat the block's
+	// first pixel.
+	static void _GatherBlock(const Job& job, int bx, int by, unsigned char block[64])
+	{
+		int x0 = bx * 4, y0 = by * 4;
+		int mx = std::min(4, job.width - x0), my = std::min(4, job.height - y0);
+		int channels = job.channels;
+		size_t stride = (size_t)job.width * channels;
+		if (channels == 4 && mx == 4 && my == 4){
+			for (int y = 0; y < 4; y++)
+				memcpy(block + y * 16, job.pixels + (y0 + y) * stride + x0 * 4, 16);
+			return;
+		}
+		int step = channels < 3 ? 0 : 1;
+		bool alpha = (channels & 1) == 0;
+		for (int y = 0; y < 4; y++){
+			for (int x = 0; x < 4; x++){
+				unsigned char* p = block + (y * 4 + x) * 4;
+				if (x >= mx || y >= my){
+					memcpy(p, block, 4);
+					continue;
+				}
+				const unsigned char* s = job.pixels + (y0 + y) * stride + (x0 + x) * channels;
+				p[0] = s[0];
+				p[1] = s[step];
+				p[2] = s[2 * step];
+				p[3] = alpha ? s[channels - 1] : 255;
+			}
+		}
+	}
+
+	// Pixel i of the four blocks, one block per lane.
+	static void _Transpose(const unsigned char blocks[4][64], __m128i pixels[16])
+	{
+		for (int i = 0; i < 16; i += 4){
+			__m128i v0 = _mm_loadu_si128((const __m128i*)(blocks[0] + i * 4));
+			__m128i v1 = _mm_loadu_si128((const __m128i*)(blocks[1] + i * 4));
+			__m128i v2 = _mm_loadu_si128((const __m128i*)(blocks[2] + i * 4));
+			__m128i v3 = _mm_loadu_si128((const __m128i*)(blocks[3] + i * 4));
+			__m128i t0 = _mm_unpacklo_epi32(v0, v1);
+			__m128i t1 = _mm_unpacklo_epi32(v2, v3);
+			__m128i t2 = _mm_unpackhi_epi32(v0, v1);
+			__m128i t3 = _mm_unpackhi_epi32(v2, v3);
+			pixels[i + 0] = _mm_unpacklo_epi64(t0, t1);
+			pixels[i + 1] = _mm_unpackhi_epi64(t0, t1);
+			pixels[i + 2] = _mm_unpacklo_epi64(t2, t3);
+			pixels[i + 3] = _mm_unpackhi_epi64(t2, t3);
+		}
+	}
+
+	static __m128 _Channel(__m128i pixel, int shift)
+	{
+		return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixel, shift), _mm_set1_epi32(255)));
+	}
+
+	// a*b + c*d + e*f, evaluated left to right as in C.
+	static __m128 _Dot3(__m128 a, __m128 b, __m128 c, __m128 d, __m128 e, __m128 f)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, b), _mm_mul_ps(c, d)), _mm_mul_ps(e, f));
+	}
+
+	static int _ConvertBitRange(int c, int from_bits, int to_bits)
+	{
+		int b = (1 << (from_bits - 1)) + c * ((1 << to_bits) - 1);
+		return (b + (b >> from_bits)) >> from_bits;
+	}
+
+	// SOIL's compute_color_line_STDEV() (covariance method),
+	// LSE_master_colors_max_min() and compress_DDS_color_block() for four
+	// blocks; encoded[k][0..7] receives block k.
+	static void _EncodeColor(const unsigned char blocks[4][64], unsigned char encoded[4][16])
+	{
+		__m128i pixels[16];
+		_Transpose(blocks, pixels);
+		__m128 r[16], g[16], b[16];
+		__m128 sum_r = _mm_setzero_ps(), sum_g = _mm_setzero_ps(), sum_b = _mm_setzero_ps();
+		__m128 sum_rr = _mm_setzero_ps(), sum_gg = _mm_setzero_ps(), sum_bb = _mm_setzero_ps();
+		__m128 sum_rg = _mm_setzero_ps(), sum_rb = _mm_setzero_ps(), sum_gb = _mm_setzero_ps();
+		// every sum is an exact integer in float, so the order does not matter
+		for (int i = 0; i < 16; i++){
+			r[i] = _Channel(pixels[i], 0);
+			g[i] = _Channel(pixels[i], 8);
+			b[i] = _Channel(pixels[i], 16);
+			sum_r = _mm_add_ps(sum_r, r[i]);
+			sum_g = _mm_add_ps(sum_g, g[i]);
+			sum_b = _mm_add_ps(sum_b, b[i]);
+			sum_rr = _mm_add_ps(sum_rr, _mm_mul_ps(r[i], r[i]));
+			sum_gg = _mm_add_ps(sum_gg, _mm_mul_ps(g[i], g[i]));
+			sum_bb = _mm_add_ps(sum_bb, _mm_mul_ps(b[i], b[i]));
+			sum_rg = _mm_add_ps(sum_rg, _mm_mul_ps(r[i], g[i]));
+			sum_rb = _mm_add_ps(sum_rb, _mm_mul_ps(r[i], b[i]));
+			sum_gb = _mm_add_ps(sum_gb, _mm_mul_ps(g[i], b[i]));
+		}
+		const __m128 inv_16 = _mm_set1_ps(1.0f / 16.0f), sixteen = _mm_set1_ps(16.0f);
+		sum_r = _mm_mul_ps(sum_r, inv_16);
+		sum_g = _mm_mul_ps(sum_g, inv_16);
+		sum_b = _mm_mul_ps(sum_b, inv_16);
+		sum_rr = _mm_sub_ps(sum_rr, _mm_mul_ps(_mm_mul_ps(sixteen, sum_r), sum_r));
+		sum_gg = _mm_sub_ps(sum_gg, _mm_mul_ps(_mm_mul_ps(sixteen, sum_g), sum_g));
+		sum_bb = _mm_sub_ps(sum_bb, _mm_mul_ps(_mm_mul_ps(sixteen, sum_b), sum_b));
+		sum_rg = _mm_sub_ps(sum_rg, _mm_mul_ps(_mm_mul_ps(sixteen, sum_r), sum_g));
+		sum_rb = _mm_sub_ps(sum_rb, _mm_mul_ps(_mm_mul_ps(sixteen, sum_r), sum_b));
+		sum_gb = _mm_sub_ps(sum_gb, _mm_mul_ps(_mm_mul_ps(sixteen, sum_g), sum_b));
+
+		// three power iterations for the main axis
+		__m128 x = _mm_set1_ps(1.0f), y = _mm_set1_ps(2.718281828f), z = _mm_set1_ps(3.141592654f);
+		for (int i = 0; i < 3; i++){
+			__m128 dx = _Dot3(x, sum_rr, y, sum_rg, z, sum_rb);
+			__m128 dy = _Dot3(x, sum_rg, y, sum_gg, z, sum_gb);
+			__m128 dz = _Dot3(x, sum_rb, y, sum_gb, z, sum_bb);
+			x = dx;
+			y = dy;
+			z = dz;
+		}
+
+		// project the pixels on the axis for the end points
+		__m128 vec_len2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_set1_ps(0.00001f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		vec_len2 = _mm_div_ps(_mm_set1_ps(1.0f), vec_len2);
+		__m128 dot_max = _Dot3(x, r[0], y, g[0], z, b[0]);
+		__m128 dot_min = dot_max;
+		for (int i = 1; i < 16; i++){
+			__m128 dot = _Dot3(x, r[i], y, g[i], z, b[i]);
+			dot_min = _mm_min_ps(dot_min, dot);
+			dot_max = _mm_max_ps(dot_max, dot);
+		}
+		__m128 offset = _Dot3(x, sum_r, y, sum_g, z, sum_b);
+		dot_min = _mm_mul_ps(_mm_sub_ps(dot_min, offset), vec_len2);
+		dot_max = _mm_mul_ps(_mm_sub_ps(dot_max, offset), vec_len2);
+		const __m128 half = _mm_set1_ps(0.5f);
+		__m128 axis[3] = { x, y, z }, mean[3] = { sum_r, sum_g, sum_b };
+		int c0[3][4], c1[3][4];
+		for (int i = 0; i < 3; i++){
+			__m128 base = _mm_add_ps(half, mean[i]);
+			_mm_storeu_si128((__m128i*)c0[i], _mm_cvttps_epi32(_mm_add_ps(base, _mm_mul_ps(dot_max, axis[i]))));
+			_mm_storeu_si128((__m128i*)c1[i], _mm_cvttps_epi32(_mm_add_ps(base, _mm_mul_ps(dot_min, axis[i]))));
+		}
+
+		// end points to 565 and back, per lane
+		float line[3][4], offset_lane[4];
+		int enc_max[4], enc_min[4];
+		for (int k = 0; k < 4; k++){
+			int e0 = 0, e1 = 0;
+			for (int i = 0; i < 3; i++){
+				int a = std::min(255, std::max(0, c0[i][k]));
+				int b = std::min(255, std::max(0, c1[i][k]));
+				int bits = i == 1 ? 6 : 5, shift = i == 0 ? 11 : (i == 1 ? 5 : 0);
+				e0 |= _ConvertBitRange(a, 8, bits) << shift;
+				e1 |= _ConvertBitRange(b, 8, bits) << shift;
+			}
+			enc_max[k] = std::max(e0, e1);
+			enc_min[k] = std::min(e0, e1);
+			int m0[3] = { _ConvertBitRange((enc_max[k] >> 11) & 31, 5, 8), _ConvertBitRange((enc_max[k] >> 5) & 63, 6, 8), _ConvertBitRange(enc_max[k] & 31, 5, 8) };
+			int m1[3] = { _ConvertBitRange((enc_min[k] >> 11) & 31, 5, 8), _ConvertBitRange((enc_min[k] >> 5) & 63, 6, 8), _ConvertBitRange(enc_min[k] & 31, 5, 8) };
+			float len2 = 0.0f;
+			for (int i = 0; i < 3; i++){
+				line[i][k] = (float)(m1[i] - m0[i]);
+				len2 += line[i][k] * line[i][k];
+			}
+			if (len2 > 0.0f)
+				len2 = 1.0f / len2;
+			for (int i = 0; i < 3; i++)
+				line[i][k] *= len2;
+			offset_lane[k] = line[0][k] * m0[0] + line[1][k] * m0[1] + line[2][k] * m0[2];
+		}
+
+		// place each pixel on the quantized line
+		__m128 lx = _mm_loadu_ps(line[0]), ly = _mm_loadu_ps(line[1]), lz = _mm_loadu_ps(line[2]);
+		__m128 line_offset = _mm_loadu_ps(offset_lane);
+		const __m128 three = _mm_set1_ps(3.0f), zero = _mm_setzero_ps();
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i packed = _mm_setzero_si128();
+		for (int i = 0; i < 16; i++){
+			__m128 dot = _mm_sub_ps(_Dot3(lx, r[i], ly, g[i], lz, b[i]), line_offset);
+			// clamping before truncation equals SOIL's clamp after it
+			__m128 value = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(dot, three), half), zero), three);
+			__m128i index = _mm_cvttps_epi32(value);
+			// SOIL's swizzle4 { 0, 2, 3, 1 }: the high bit of v becomes the low bit
+			__m128i high = _mm_srli_epi32(index, 1);
+			__m128i swizzled = _mm_or_si128(high, _mm_slli_epi32(_mm_and_si128(_mm_xor_si128(index, high), one), 1));
+			packed = _mm_or_si128(packed, _mm_sll_epi32(swizzled, _mm_cvtsi32_si128(2 * i)));
+		}
+		unsigned int indices[4];
+		_mm_storeu_si128((__m128i*)indices, packed);
+		for (int k = 0; k < 4; k++){
+			unsigned int bits = indices[k];
+			unsigned char* out = encoded[k];
+			out[0] = (unsigned char)(enc_max[k] & 255);
+			out[1] = (unsigned char)(enc_max[k] >> 8);
+			out[2] = (unsigned char)(enc_min[k] & 255);
+			out[3] = (unsigned char)(enc_min[k] >> 8);
+			memcpy(out + 4, &bits, 4);
+		}
+	}
+
+	// SOIL's compress_DDS_alpha_block() for four blocks; encoded[k][8..15]
+	// receives block k. A flat block scales by 7.9999 / 0 there, and the NaN
+	// this gives converts to index 0 on x86; the SSE conversion does the same.
+	static void _EncodeAlpha(const unsigned char blocks[4][64], unsigned char encoded[4][16])
+	{
+		__m128i pixels[16];
+		_Transpose(blocks, pixels);
+		__m128i alpha[16];
+		__m128i a0 = _mm_srli_epi32(pixels[0], 24), a1 = a0;
+		for (int i = 0; i < 16; i++){
+			alpha[i] = _mm_srli_epi32(pixels[i], 24);
+			// values fit 16 bits, so the 16-bit min/max work on the 32-bit lanes
+			a0 = _mm_max_epi16(a0, alpha[i]);
+			a1 = _mm_min_epi16(a1, alpha[i]);
+		}
+		__m128 low = _mm_cvtepi32_ps(a1);
+		__m128 scale = _mm_div_ps(_mm_set1_ps(7.9999f), _mm_cvtepi32_ps(_mm_sub_epi32(a0, a1)));
+		const __m128i seven = _mm_set1_epi32(7), eight = _mm_set1_epi32(8), two = _mm_set1_epi32(2), one = _mm_set1_epi32(1);
+		// 24 bits of indices for each half of the block
+		__m128i packed[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+		for (int i = 0; i < 16; i++){
+			__m128i value = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(alpha[i]), low), scale)), seven);
+			// SOIL's swizzle8 { 1, 7, 6, 5, 4, 3, 2, 0 }: (8 - v) & 7, then 0 and 1 swap
+			__m128i swizzled = _mm_and_si128(_mm_sub_epi32(eight, value), seven);
+			swizzled = _mm_xor_si128(swizzled, _mm_and_si128(_mm_cmplt_epi32(swizzled, two), one));
+			packed[i / 8] = _mm_or_si128(packed[i / 8], _mm_sll_epi32(swizzled, _mm_cvtsi32_si128(3 * (i % 8))));
+		}
+		unsigned int high[4], lowest[4], bits[2][4];
+		_mm_storeu_si128((__m128i*)high, a0);
+		_mm_storeu_si128((__m128i*)lowest, a1);
+		_mm_storeu_si128((__m128i*)bits[0], packed[0]);
+		_mm_storeu_si128((__m128i*)bits[1], packed[1]);
+		for (int k = 0; k < 4; k++){
+			unsigned char* out = encoded[k] + 8;
+			out[0] = (unsigned char)high[k];
+			out[1] = (unsigned char)lowest[k];
+			for (int i = 0; i < 3; i++){
+				out[2 + i] = (unsigned char)(bits[0][k] >> (8 * i));
+				out[5 + i] = (unsigned char)(bits[1][k] >> (8 * i));
+			}
+		}
+	}
+
+	std::unique_ptr<ThreadPool> _pool;
+};
+
+#endif
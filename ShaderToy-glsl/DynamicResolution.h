@@ -0,0 +1,177 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include "FullscreenTriangle.h"
+#include "Shader.h"
+#include "RenderGraph.h"
+#include "Headless.h"
+#include "GpuTimer.h"
+
+struct DynamicResolutionSettings
+{
+	double target_ms = 16.0;		// GPU frame time budget
+	float min_scale = 0.5f;
+	float max_scale = 1.0f;
+	float step = 0.05f;				// scales are multiples of this
+	double lower_margin = 0.05;		// shrink when above target * (1 + lower_margin)
+	double raise_margin = 0.10;		// grow when a step up stays below target * (1 - raise_margin)
+};
+
+// Feedback controller for the render scale. It follows an exponential moving
+// average of the GPU frame time. Hysteresis keeps it from oscillating:
+// - it shrinks only once the average exceeds the budget by lower_margin, and
+//   grows only if one step up is predicted to stay raise_margin under it;
+// - scales are quantized to step;
+// - after a change it waits until the timer reports frames rendered at the
+//   new scale before judging again.
+// Frame time is taken to scale with the pixel count, i.e. scale squared.
+class ResolutionController
+{
+public:
+	ResolutionController() {}
+
+	explicit ResolutionController(const DynamicResolutionSettings& settings)
+		: _settings(settings), _scale(settings.max_scale)
+	{
+	}
+
+	// Feed one GPU frame time. Returns true when the scale changed.
+	bool update(double gpu_ms)
+	{
+		if (_settle > 0){
+			_settle--;
+			return false;
+		}
+		_ema = _ema < 0.0 ? gpu_ms : _ema + 0.1 * (gpu_ms - _ema);
+		if (++_samples < MIN_SAMPLES)
+			return false;
+
+		float scale = _scale;
+		const DynamicResolutionSettings& s = _settings;
+		if (_ema > s.target_ms * (1.0 + s.lower_margin)){
+			float wanted = _scale * (float)sqrt(s.target_ms / _ema);
+			scale = floorf(wanted / s.step) * s.step;
+			scale = std::min(scale, _scale - s.step);
+		}
+		else{
+			float up = _scale + s.step;
+			double predicted = _ema * (up * up) / (_scale * _scale);
+			if (predicted < s.target_ms * (1.0 - s.raise_margin))
+				scale = up;
+		}
+		scale = std::max(s.min_scale, std::min(s.max_scale, scale));
+		if (fabsf(scale - _scale) < s.step * 0.5f)
+			return false;
+		_scale = scale;
+		_ema = -1.0;
+		_samples = 0;
+		_settle = GpuTimer::FRAMES_IN_FLIGHT;
+		return true;
+	}
+
+	float scale() const
+	{
+		return _scale;
+	}
+
+private:
+	enum { MIN_SAMPLES = 8 };
+
+	DynamicResolutionSettings _settings;
+	float _scale = 1.0f;
+	double _ema = -1.0;
+	int _samples = 0;
+	int _settle = 0;
+};
+
+// Renders a graph at a scaled internal resolution and upscales the result to
+// the output size. The graph's Image pass draws into the lower-left corner of
+// a target allocated once at max_scale; buffer passes are resized with the
+// graph. iResolution must be set from internal_size() so shaders see the
+// internal resolution.
+class DynamicResolution
+{
+public:
+	DynamicResolution() {}
+
+	bool init(int output_width, int output_height, const DynamicResolutionSettings& settings, float sharpness = 0.0f)
+	{
+		_settings = settings;
+		_controller = ResolutionController(settings);
+		_output = glm::ivec2(output_width, output_height);
+		_sharpness = sharpness;
+		_target.init(std::max(1, (int)ceilf(output_width * settings.max_scale)),
+			std::max(1, (int)ceilf(output_height * settings.max_scale)));
+		_upscale.init("shader/fullscreen_vert.glsl", "shader/upscale_frag.glsl", false);
+		_u_source = _upscale.uniform<Sampler>("source");
+		_u_uv_scale = _upscale.uniform<glm::vec2>("uv_scale");
+		_u_texel = _upscale.uniform<glm::vec2>("texel");
+		_u_sharpness = _upscale.uniform<float>("sharpness");
+		return _upscale.ready();
+	}
+
+	// Route graph's Image pass into the scaled target and size the graph to
+	// the current internal resolution. Call for each graph that is drawn.
+	void attach(RenderGraph& graph)
+	{
+		graph.set_output(_target.framebuffer());
+		glm::ivec2 size = internal_size();
+		graph.resize(size.x, size.y);
+	}
+
+	// Feed the last GPU frame time. Returns true when the internal resolution
+	// changed, i.e. attach() must be called again.
+	bool update(double gpu_ms)
+	{
+		return _controller.update(gpu_ms);
+	}
+
+	glm::ivec2 internal_size() const
+	{
+		float scale = _controller.scale();
+		return glm::ivec2(std::max(1, (int)(_output.x * scale + 0.5f)), std::max(1, (int)(_output.y * scale + 0.5f)));
+	}
+
+	float scale() const
+	{
+		return _controller.scale();
+	}
+
+	// Upscale the internal image into framebuffer (0 is the window).
+	void present(FullscreenTriangle& quad, GLuint framebuffer = 0)
+	{
+		glm::ivec2 size = internal_size();
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, _output.x, _output.y);
+		_upscale.use();
+		_upscale.set(_u_source, _target.texture(), 0);
+		_upscale.set(_u_uv_scale, glm::vec2((float)size.x / _target.width(), (float)size.y / _target.height()));
+		_upscale.set(_u_texel, glm::vec2(1.0f / _target.width(), 1.0f / _target.height()));
+		_upscale.set(_u_sharpness, _sharpness);
+		quad.render();
+	}
+
+	void destory()
+	{
+		_target.destory();
+	}
+
+private:
+	DynamicResolutionSettings _settings;
+	ResolutionController _controller;
+	glm::ivec2 _output = glm::ivec2(0);
+	float _sharpness = 0.0f;
+	RenderTarget _target;
+	Shader _upscale;
+	Uniform<Sampler> _u_source;
+	Uniform<glm::vec2> _u_uv_scale;
+	Uniform<glm::vec2> _u_texel;
+	Uniform<float> _u_sharpness;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h> // _mkdir
+#include <process.h> // _getpid
+#include <io.h> // _access
+#include <psapi.h> // GetProcessMemoryInfo
+#include <sys/types.h>
+#include <sys/stat.h> // _stat64
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Creates dir unless it exists. Only the last path component is created.
+inline bool make_directory(const std::string& dir)
+{
+#ifdef _WIN32
+	int r = _mkdir(dir.c_str());
+#else
+	int r = mkdir(dir.c_str(), 0755);
+#endif
+	return r == 0 || errno == EEXIST;
+}
+
+// Moves from over to, replacing it. Readers of to see either the old or the
+// new file, never a partly written one.
+inline bool replace_file(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+inline bool file_exists(const std::string& path)
+{
+#ifdef _WIN32
+	return _access(path.c_str(), 0) == 0;
+#else
+	return access(path.c_str(), F_OK) == 0;
+#endif
+}
+
+// Size and modification time of a file: tells a changed file from the one
+// seen before without reading it.
+struct FileStamp
+{
+	long long size = -1;
+	long long mtime = 0;		// ns on POSIX, s on Windows
+
+	bool operator==(const FileStamp& other) const
+	{
+		return size == other.size && mtime == other.mtime;
+	}
+};
+
+inline bool file_stamp(const std::string& path, FileStamp& stamp)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+	stamp.mtime = (long long)st.st_mtime;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+#ifdef __APPLE__
+	stamp.mtime = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+	stamp.mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+	stamp.size = (long long)st.st_size;
+	return true;
+}
+
+inline int process_id()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return (int)getpid();
+#endif
+}
+
+// Drops path's pages from the OS file cache so the next read comes from the
+// disk, e.g. to time a cold load. Linux evicts them on request; Windows does
+// when the file is opened without buffering. Pages mapped by any process
+// stay.
+inline void evict_file_cache(const std::string& path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+#endif
+}
+
+#ifndef _WIN32
+// A "Name:  value kB" line of /proc/self/status, in bytes.
+inline size_t _proc_status_bytes(const char* name)
+{
+	FILE* f = fopen("/proc/self/status", "r");
+	if (f == NULL)
+		return 0;
+	char line[256];
+	size_t kb = 0, n = strlen(name);
+	while (fgets(line, sizeof(line), f))
+		if (strncmp(line, name, n) == 0 && line[n] == ':')
+			kb = (size_t)strtoull(line + n + 1, NULL, 10);
+	fclose(f);
+	return kb * 1024;
+}
+#endif
+
+// Memory of this process that is resident now, in bytes.
+inline size_t resident_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+	return _proc_status_bytes("VmRSS");
+#endif
+}
+
+// The most that was resident at once, in bytes, since the start or since
+// reset_peak_resident(). Windows can not reset the peak, so it only grows
+// there.
+inline size_t peak_resident_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+	return _proc_status_bytes("VmHWM");
+#endif
+}
+
+inline void reset_peak_resident()
+{
+#ifndef _WIN32
+	FILE* f = fopen("/proc/self/clear_refs", "w");
+	if (f == NULL)
+		return;
+	fputs("5", f);
+	fclose(f);
+#endif
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+// Normalizes a relative or absolute path so paths reported by the watcher
+// and paths recorded by the shader loader compare equal: forward slashes,
+// no "./" segments and ".." folded where possible.
+inline std::string normalize_path(const std::string& path)
+{
+	std::string p = path;
+	for (size_t i = 0; i < p.size(); i++)
+		if (p[i] == '\\') p[i] = '/';
+	std::vector<std::string> parts;
+	size_t pos = 0;
+	bool absolute = !p.empty() && p[0] == '/';
+	while (pos <= p.size()){
+		size_t end = p.find('/', pos);
+		if (end == std::string::npos) end = p.size();
+		std::string part = p.substr(pos, end - pos);
+		pos = end + 1;
+		if (part.empty() || part == ".")
+			continue;
+		if (part == ".." && !parts.empty() && parts.back() != "..")
+			parts.pop_back();
+		else
+			parts.push_back(part);
+	}
+	std::string out = absolute ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++){
+		if (i) out += "/";
+		out += parts[i];
+	}
+	return out;
+}
+
+inline std::string directory_of(const std::string& path)
+{
+	std::string p = normalize_path(path);
+	size_t slash = p.rfind('/');
+	return slash == std::string::npos ? "." : p.substr(0, slash);
+}
+
+// Event-driven watcher for files in a set of directories. The OS blocks a
+// background thread (inotify on Linux, ReadDirectoryChangesW on Windows) and
+// changed paths are queued for the render thread. has_changes() is a single
+// atomic load, so an idle watcher costs nothing per frame.
+class FileWatcher
+{
+public:
+	FileWatcher()
+	{
+#ifdef _WIN32
+		_stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+#else
+		_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (_inotify < 0 || pipe(_wake) != 0){
+			printf("File watcher unavailable: inotify init failed\n");
+			return;
+		}
+		_threads.push_back(std::thread(&FileWatcher::_InotifyLoop, this));
+#endif
+	}
+
+	~FileWatcher()
+	{
+		_stop = true;
+#ifdef _WIN32
+		SetEvent(_stop_event);
+#else
+		if (_wake[1] >= 0){
+			char c = 0;
+			if (write(_wake[1], &c, 1) < 0) {}
+		}
+#endif
+		for (size_t i = 0; i < _threads.size(); i++)
+			_threads[i].join();
+#ifdef _WIN32
+		for (size_t i = 0; i < _handles.size(); i++)
+			CloseHandle(_handles[i]);
+		CloseHandle(_stop_event);
+#else
+		if (_inotify >= 0) close(_inotify);
+		if (_wake[0] >= 0) close(_wake[0]);
+		if (_wake[1] >= 0) close(_wake[1]);
+#endif
+	}
+
+	// Watch the directory containing path. Watching the same directory twice
+	// is a no-op.
+	void watch_file(const std::string& path)
+	{
+		watch_directory(directory_of(path));
+	}
+
+	void watch_directory(const std::string& dir)
+	{
+		std::string d = normalize_path(dir);
+		if (d.empty()) d = ".";
+		if (_directories.count(d))
+			return;
+		_directories.insert(d);
+#ifdef _WIN32
+		HANDLE h = CreateFileA(d.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+		if (h == INVALID_HANDLE_VALUE){
+			printf("Can not watch directory %s\n", d.c_str());
+			return;
+		}
+		_handles.push_back(h);
+		_threads.push_back(std::thread(&FileWatcher::_DirectoryLoop, this, h, d));
+#else
+		if (_inotify < 0)
+			return;
+		int wd = inotify_add_watch(_inotify, d.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0){
+			printf("Can not watch directory %s\n", d.c_str());
+			return;
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		_watch_dirs[wd] = d;
+#endif
+	}
+
+	bool has_changes() const
+	{
+		return _dirty.load(std::memory_order_acquire);
+	}
+
+	// Returns the normalized paths changed since the last call.
+	std::vector<std::string> take_changes()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::vector<std::string> changes(_changes.begin(), _changes.end());
+		_changes.clear();
+		_dirty.store(false, std::memory_order_release);
+		return changes;
+	}
+
+private:
+	void _Push(const std::string& dir, const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_changes.insert(normalize_path(dir + "/" + name));
+		_dirty.store(true, std::memory_order_release);
+	}
+
+#ifdef _WIN32
+	void _DirectoryLoop(HANDLE h, std::string dir)
+	{
+		DWORD buffer[4096];
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(ov));
+		ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		HANDLE events[2] = { ov.hEvent, _stop_event };
+		for (;;){
+			ResetEvent(ov.hEvent);
+			if (!ReadDirectoryChangesW(h, buffer, sizeof(buffer), FALSE,
+				FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &ov, NULL))
+				break;
+			DWORD bytes = 0;
+			if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0){
+				// stop requested
+				CancelIo(h);
+				GetOverlappedResult(h, &ov, &bytes, TRUE);
+				break;
+			}
+			if (!GetOverlappedResult(h, &ov, &bytes, FALSE))
+				break;
+			if (bytes == 0)
+				continue;	// buffer overflow, nothing to report
+			const char* p = (const char*)buffer;
+			for (;;){
+				const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+				int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), NULL, 0, NULL, NULL);
+				std::string name(length, '\0');
+				WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), &name[0], length, NULL, NULL);
+				_Push(dir, name);
+				if (info->NextEntryOffset == 0)
+					break;
+				p += info->NextEntryOffset;
+			}
+		}
+		CloseHandle(ov.hEvent);
+	}
+#else
+	void _InotifyLoop()
+	{
+		alignas(struct inotify_event) char buffer[16 * 1024];
+		struct pollfd fds[2] = { { _inotify, POLLIN, 0 }, { _wake[0], POLLIN, 0 } };
+		while (!_stop){
+			if (poll(fds, 2, -1) <= 0)
+				continue;
+			if (fds[1].revents)
+				return;
+			ssize_t n;
+			while ((n = read(_inotify, buffer, sizeof(buffer))) > 0){
+				for (char* p = buffer; p < buffer + n;){
+					const struct inotify_event* ev = (const struct inotify_event*)p;
+					if (ev->len > 0){
+						std::string dir;
+						{
+							std::lock_guard<std::mutex> lock(_mutex);
+							std::map<int, std::string>::iterator it = _watch_dirs.find(ev->wd);
+							if (it != _watch_dirs.end()) dir = it->second;
+						}
+						if (!dir.empty())
+							_Push(dir, ev->name);
+					}
+					p += sizeof(struct inotify_event) + ev->len;
+				}
+			}
+		}
+	}
+#endif
+
+	std::set<std::string> _directories;
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::set<std::string> _changes;
+	std::atomic<bool> _dirty{ false };
+	std::atomic<bool> _stop{ false };
+#ifdef _WIN32
+	std::vector<HANDLE> _handles;
+	HANDLE _stop_event = NULL;
+#else
+	int _inotify = -1;
+	int _wake[2] = { -1, -1 };
+	std::map<int, std::string> _watch_dirs;
+#endif
+};
+
+#endif
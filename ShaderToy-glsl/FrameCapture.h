@@ -0,0 +1,254 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glew.h>
+#include <soil/SOIL.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "ThreadPool.h"
+
+struct FrameCaptureStats
+{
+	unsigned int captured = 0;
+	unsigned int written = 0;
+	unsigned int failed = 0;
+	unsigned int stalls = 0;		// captures that had to wait for an old readback
+};
+
+// Asynchronous readback of rendered frames. Each capture() copies the
+// framebuffer into the next pixel pack buffer of a ring and fences it; the
+// copy runs on the GPU while later frames are drawn. A buffer is only mapped
+// once its fence has signaled, and its pixels are flipped and encoded to an
+// image file on a worker pool, so the render thread never waits on
+// glReadPixels or on the encoder.
+class FrameCapture
+{
+public:
+	enum { MIN_RING_SIZE = 3 };
+
+	FrameCapture() {}
+
+	~FrameCapture()
+	{
+		destory();
+	}
+
+	// pattern is a printf pattern for the frame number; a .bmp extension
+	// writes BMP, anything else TGA.
+	bool init(int width, int height, const std::string& pattern, int ring_size = 4, unsigned int threads = 0)
+	{
+		destory();
+		_width = width;
+		_height = height;
+		_pattern = pattern;
+		_save_type = SOIL_SAVE_TYPE_TGA;
+		size_t dot = pattern.rfind('.');
+		if (dot != std::string::npos && pattern.compare(dot, std::string::npos, ".bmp") == 0)
+			_save_type = SOIL_SAVE_TYPE_BMP;
+		if (ring_size < MIN_RING_SIZE)
+			ring_size = MIN_RING_SIZE;
+
+		_slots.resize(ring_size);
+		GLsizeiptr size = (GLsizeiptr)width * height * 4;
+		for (size_t i = 0; i < _slots.size(); i++){
+			glGenBuffers(1, &_slots[i].buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, _slots[i].buffer);
+			glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, GL_MAP_READ_BIT);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		_next = 0;
+		// encoding is much slower than the readback; the pool's bounded queue
+		// lets a few frames per worker pile up before capture() pushes back
+		_pool.reset(new ThreadPool(threads));
+		_stats = FrameCaptureStats();
+		_written = 0;
+		_failed = 0;
+		return glGetError() == GL_NO_ERROR;
+	}
+
+	void destory()
+	{
+		if (_slots.empty())
+			return;
+		flush();
+		for (size_t i = 0; i < _slots.size(); i++){
+			if (_slots[i].fence) glDeleteSync(_slots[i].fence);
+			glDeleteBuffers(1, &_slots[i].buffer);
+		}
+		_slots.clear();
+		_pool.reset();
+		// sized for this ring's frames; the next init() may be larger
+		std::lock_guard<std::mutex> lock(_free_mutex);
+		_free.clear();
+	}
+
+	// Queue a readback of the color attachment of framebuffer. Call after the
+	// frame has been drawn into it.
+	void capture(GLuint framebuffer, int frame)
+	{
+		if (_slots.empty())
+			return;
+		Slot& slot = _slots[_next];
+		if (slot.fence){
+			_stats.stalls++;
+			_Harvest(slot, true);
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frame = frame;
+		_next = (_next + 1) % _slots.size();
+		_stats.captured++;
+		collect();
+	}
+
+	// Hand every finished readback to the encoder without blocking. capture()
+	// calls this too; call it once per frame when not capturing.
+	void collect()
+	{
+		// oldest first, so frames reach the pool in order
+		for (size_t i = 0; i < _slots.size(); i++){
+			Slot& slot = _slots[(_next + i) % _slots.size()];
+			if (slot.fence && !_Harvest(slot, false))
+				break;
+		}
+	}
+
+	// Block until every queued frame is written.
+	void flush()
+	{
+		for (size_t i = 0; i < _slots.size(); i++){
+			Slot& slot = _slots[(_next + i) % _slots.size()];
+			if (slot.fence)
+				_Harvest(slot, true);
+		}
+		if (_pool)
+			_pool->wait_idle();
+	}
+
+	FrameCaptureStats stats() const
+	{
+		FrameCaptureStats s = _stats;
+		s.written = _written;
+		s.failed = _failed;
+		return s;
+	}
+
+	void print_stats() const
+	{
+		FrameCaptureStats s = stats();
+		printf("frame capture: %u captured, %u written, %u failed, %u stalls on a %d buffer ring\n",
+			s.captured, s.written, s.failed, s.stalls, (int)_slots.size());
+	}
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		GLsync fence = 0;
+		int frame = 0;
+	};
+
+	typedef std::shared_ptr<std::vector<unsigned char>> PixelBuffer;
+
+	// Copy a signaled slot out and queue it for encoding. Returns false if the
+	// readback is still in flight and wait is false.
+	bool _Harvest(Slot& slot, bool wait)
+	{
+		GLenum r = glClientWaitSync(slot.fence, 0, 0);
+		if (r == GL_TIMEOUT_EXPIRED && !wait)
+			return false;
+		while (r == GL_TIMEOUT_EXPIRED)
+			r = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		size_t size = (size_t)_width * _height * 4;
+		PixelBuffer pixels = _AcquireBuffer(size);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (mapped){
+			memcpy(&(*pixels)[0], mapped, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (mapped == NULL){
+			printf("Failed to map the readback of frame %d\n", slot.frame);
+			_failed++;
+			_ReleaseBuffer(pixels);
+			return true;
+		}
+
+		int frame = slot.frame;
+		_pool->submit([this, pixels, frame]{ _Encode(pixels, frame); });
+		return true;
+	}
+
+	// Worker side: RGBA bottom-up rows to RGB top-down, then write the file.
+	void _Encode(PixelBuffer pixels, int frame)
+	{
+		std::vector<unsigned char> rgb((size_t)_width * _height * 3);
+		for (int y = 0; y < _height; y++){
+			const unsigned char* src = &(*pixels)[(size_t)(_height - 1 - y) * _width * 4];
+			unsigned char* dst = &rgb[(size_t)y * _width * 3];
+			for (int x = 0; x < _width; x++){
+				dst[x * 3 + 0] = src[x * 4 + 0];
+				dst[x * 3 + 1] = src[x * 4 + 1];
+				dst[x * 3 + 2] = src[x * 4 + 2];
+			}
+		}
+		_ReleaseBuffer(pixels);
+		char path[1024];
+		snprintf(path, sizeof(path), _pattern.c_str(), frame);
+		if (SOIL_save_image(path, _save_type, _width, _height, 3, &rgb[0]))
+			_written++;
+		else{
+			printf("Can not write %s\n", path);
+			_failed++;
+		}
+	}
+
+	PixelBuffer _AcquireBuffer(size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_free_mutex);
+			if (!_free.empty()){
+				PixelBuffer b = _free.back();
+				_free.pop_back();
+				b->resize(size);
+				return b;
+			}
+		}
+		return PixelBuffer(new std::vector<unsigned char>(size));
+	}
+
+	void _ReleaseBuffer(PixelBuffer b)
+	{
+		std::lock_guard<std::mutex> lock(_free_mutex);
+		_free.push_back(b);
+	}
+
+	std::vector<Slot> _slots;
+	size_t _next = 0;
+	int _width = 0;
+	int _height = 0;
+	std::string _pattern;
+	int _save_type = SOIL_SAVE_TYPE_TGA;
+	std::unique_ptr<ThreadPool> _pool;
+	std::mutex _free_mutex;
+	std::vector<PixelBuffer> _free;
+	FrameCaptureStats _stats;
+	std::atomic<unsigned int> _written{ 0 };
+	std::atomic<unsigned int> _failed{ 0 };
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <chrono>
+#include <stdio.h>
+#include <glew.h>
+
+// Playback time of the interactive player: iTime, iTimeDelta, iFrame and
+// iFrameRate. Real time comes from steady_clock, which is monotonic and
+// counts while the process sleeps in the swap. Time is kept in double
+// seconds and only narrowed to float for the shader, so it stays exact
+// after hours of playback.
+//
+// With a fixed step every tick advances time by exactly that step, as the
+// headless renderer does, whatever the real frame took: animation is then
+// reproducible but runs slow when frames are late.
+class FrameClock
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	FrameClock()
+	{
+		_last = clock::now();
+	}
+
+	// Advance to the next frame. Call once per frame before reading time().
+	void tick()
+	{
+		clock::time_point now = clock::now();
+		double real_delta = std::chrono::duration<double>(now - _last).count();
+		_last = now;
+		if (_ticks > 0 && real_delta > 0.0){
+			// smoothed over roughly the last 30 frames, like a frame counter
+			double rate = 1.0 / real_delta;
+			_frame_rate = _frame_rate > 0.0 ? _frame_rate + (rate - _frame_rate) / 30.0 : rate;
+		}
+		if (_ticks > 0 && !_paused && !_seeked){
+			_delta = _fixed_step > 0.0 ? _fixed_step : real_delta;
+			_time += _delta;
+			_frame++;
+		}
+		else
+			_delta = 0.0;
+		_seeked = false;
+		_ticks++;
+	}
+
+	// Playback seconds of this frame.
+	double time() const
+	{
+		return _time;
+	}
+
+	// Seconds since the previous frame's time; 0 while paused.
+	double delta() const
+	{
+		return _delta;
+	}
+
+	// Frames played; does not advance while paused.
+	int frame() const
+	{
+		return _frame;
+	}
+
+	// Real frames per second, whether paused or not.
+	double frame_rate() const
+	{
+		return _frame_rate;
+	}
+
+	void set_paused(bool paused)
+	{
+		_paused = paused;
+	}
+
+	bool paused() const
+	{
+		return _paused;
+	}
+
+	// Jump to seconds; the next tick lands exactly there.
+	void seek(double seconds)
+	{
+		_time = seconds > 0.0 ? seconds : 0.0;
+		_delta = 0.0;
+		_seeked = true;
+	}
+
+	// Back to time 0 and frame 0, e.g. to restart a shader with feedback.
+	void restart()
+	{
+		seek(0.0);
+		_frame = 0;
+	}
+
+	// 0 follows real time; otherwise each tick advances by seconds.
+	void set_fixed_step(double seconds)
+	{
+		_fixed_step = seconds > 0.0 ? seconds : 0.0;
+	}
+
+	double fixed_step() const
+	{
+		return _fixed_step;
+	}
+
+private:
+	clock::time_point _last;
+	double _time = 0.0;
+	double _delta = 0.0;
+	double _frame_rate = 0.0;
+	double _fixed_step = 0.0;
+	int _frame = 0;
+	unsigned int _ticks = 0;
+	bool _paused = false;
+	bool _seeked = false;
+};
+
+// Bounds the frames the CPU may queue ahead of the GPU. end_frame() fences
+// each frame after the swap; wait() blocks until no more than max_in_flight
+// frames are unfinished. Waiting before input is sampled keeps the time from
+// input to display at about max_in_flight frames, where drivers otherwise
+// queue three or more. Uses the same fence loop as ShaderToyInputsRing.
+class FramePacer
+{
+public:
+	enum { MAX_FRAMES = 8 };
+
+	FramePacer()
+	{
+		for (int i = 0; i < MAX_FRAMES; i++)
+			_fences[i] = 0;
+	}
+
+	~FramePacer()
+	{
+		destory();
+	}
+
+	// 0 turns pacing off.
+	void init(int max_in_flight)
+	{
+		destory();
+		_max_in_flight = max_in_flight < 0 ? 0 : (max_in_flight > MAX_FRAMES ? MAX_FRAMES : max_in_flight);
+		_slot = 0;
+	}
+
+	// Block until the frame max_in_flight frames back has finished on the GPU.
+	// Call at the top of the frame, before polling input.
+	void wait()
+	{
+		if (_max_in_flight == 0 || !_fences[_slot])
+			return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		GLenum r = glClientWaitSync(_fences[_slot], 0, 0);
+		while (r == GL_TIMEOUT_EXPIRED)
+			r = glClientWaitSync(_fences[_slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(_fences[_slot]);
+		_fences[_slot] = 0;
+		_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		_waits++;
+	}
+
+	// Fence the frame just submitted. Call after the swap.
+	void end_frame()
+	{
+		if (_max_in_flight == 0)
+			return;
+		if (_fences[_slot])
+			glDeleteSync(_fences[_slot]);
+		_fences[_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		_slot = (_slot + 1) % _max_in_flight;
+		_frames++;
+	}
+
+	void destory()
+	{
+		for (int i = 0; i < MAX_FRAMES; i++){
+			if (_fences[i]) glDeleteSync(_fences[i]);
+			_fences[i] = 0;
+		}
+	}
+
+	void print_summary() const
+	{
+		if (_max_in_flight == 0)
+			return;
+		printf("frame pacing: %d frame(s) in flight, %u frames, waited on %u for %.2f ms per frame\n",
+			_max_in_flight, _frames, _waits, _frames > 0 ? _wait_ms / _frames : 0.0);
+	}
+
+private:
+	int _max_in_flight = 0;
+	int _slot = 0;
+	GLsync _fences[MAX_FRAMES];
+	unsigned int _frames = 0;
+	unsigned int _waits = 0;
+	double _wait_ms = 0.0;
+};
+
+#endif
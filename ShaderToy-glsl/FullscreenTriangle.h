@@ -0,0 +1,44 @@
+#ifndef FULLSCREEN_TRIANGLE_H
+#define FULLSCREEN_TRIANGLE_H
+
+#include <glew.h>
+
+// One triangle covering the whole viewport, for passes that shade every
+// pixel. It has no vertex buffers: shader/fullscreen_vert.glsl builds the
+// corners (-1,-1), (3,-1) and (-1,3) from gl_VertexID, so the VAO stays
+// empty. Compared with a two-triangle quad there is no diagonal edge where
+// the GPU shades the 2x2 quads along the seam twice.
+class FullscreenTriangle
+{
+public:
+	FullscreenTriangle() {}
+
+	~FullscreenTriangle()
+	{
+		destory();
+	}
+
+	void init()
+	{
+		if (_vao == 0)
+			glGenVertexArrays(1, &_vao);
+	}
+
+	void render()
+	{
+		glBindVertexArray(_vao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	void destory()
+	{
+		if (_vao != 0)
+			glDeleteVertexArrays(1, &_vao);
+		_vao = 0;
+	}
+
+private:
+	GLuint _vao = 0;
+};
+
+#endif
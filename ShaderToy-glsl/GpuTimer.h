@@ -0,0 +1,268 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glew.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+struct GpuTimerStats
+{
+	unsigned int samples = 0;		// in the rolling window
+	double min_ms = 0.0;
+	double avg_ms = 0.0;
+	double p50_ms = 0.0;
+	double p95_ms = 0.0;
+	double p99_ms = 0.0;
+	double max_ms = 0.0;
+};
+
+// GPU time per named scope (a render pass, the whole frame, ...). begin() and
+// end() each write a GL_TIMESTAMP query, so scopes may nest. Queries live in
+// FRAMES_IN_FLIGHT per-frame slots; a slot is read back when it comes round
+// again, by which time the GPU has normally finished it. Results are only read
+// once GL_QUERY_RESULT_AVAILABLE says so; a frame still in flight is dropped
+// rather than waited for, so timing never stalls the pipeline.
+class GpuTimer
+{
+public:
+	enum { FRAMES_IN_FLIGHT = 5 };
+
+	// window is the number of recent samples per scope the statistics cover.
+	explicit GpuTimer(size_t window = 240)
+		: _window(window > 0 ? window : 1)
+	{
+		scope("frame");
+	}
+
+	~GpuTimer()
+	{
+		destory();
+	}
+
+	// Id of the named scope, registered on first use. Scope 0 is "frame",
+	// timed by begin_frame()/end_frame().
+	int scope(const std::string& name)
+	{
+		for (size_t i = 0; i < _scopes.size(); i++)
+			if (_scopes[i].name == name)
+				return (int)i;
+		_scopes.push_back(Scope());
+		_scopes.back().name = name;
+		return (int)_scopes.size() - 1;
+	}
+
+	void begin_frame()
+	{
+		_slot = (_slot + 1) % FRAMES_IN_FLIGHT;
+		FrameSlot& slot = _frames[_slot];
+		if (slot.pending)
+			_Collect(slot, true);
+		slot.used.assign(_scopes.size(), 0);
+		begin(FRAME_SCOPE);
+	}
+
+	void end_frame()
+	{
+		end(FRAME_SCOPE);
+		FrameSlot& slot = _frames[_slot];
+		slot.last_query = slot.queries[FRAME_SCOPE * 2 + 1];
+		slot.pending = true;
+	}
+
+	void begin(int scope)
+	{
+		FrameSlot& slot = _frames[_slot];
+		_Reserve(slot);
+		if ((size_t)scope >= slot.used.size())
+			slot.used.resize(_scopes.size(), 0);
+		glQueryCounter(slot.queries[scope * 2], GL_TIMESTAMP);
+		slot.used[scope] = 1;
+	}
+
+	void end(int scope)
+	{
+		FrameSlot& slot = _frames[_slot];
+		glQueryCounter(slot.queries[scope * 2 + 1], GL_TIMESTAMP);
+	}
+
+	// Read back every frame whose results are already available, e.g. before
+	// printing statistics at the end of a run. Never waits.
+	void collect()
+	{
+		for (int i = 1; i <= FRAMES_IN_FLIGHT; i++){
+			FrameSlot& slot = _frames[(_slot + i) % FRAMES_IN_FLIGHT];
+			if (slot.pending)
+				_Collect(slot, false);
+		}
+	}
+
+	// Statistics over the rolling window of scope.
+	GpuTimerStats stats(int scope) const
+	{
+		GpuTimerStats s;
+		const std::vector<double>& samples = _scopes[scope].samples;
+		if (samples.empty())
+			return s;
+		std::vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+		s.samples = (unsigned int)sorted.size();
+		s.min_ms = sorted.front();
+		s.max_ms = sorted.back();
+		double sum = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++)
+			sum += sorted[i];
+		s.avg_ms = sum / sorted.size();
+		s.p50_ms = _Percentile(sorted, 0.50);
+		s.p95_ms = _Percentile(sorted, 0.95);
+		s.p99_ms = _Percentile(sorted, 0.99);
+		return s;
+	}
+
+	// Most recent result of scope and how many results it has had in total;
+	// a controller polls these each frame and reacts when the count moves.
+	double latest_ms(int scope) const
+	{
+		return _scopes[scope].latest_ms;
+	}
+
+	unsigned int total_samples(int scope) const
+	{
+		return _scopes[scope].total;
+	}
+
+	int scope_count() const
+	{
+		return (int)_scopes.size();
+	}
+
+	const std::string& scope_name(int scope) const
+	{
+		return _scopes[scope].name;
+	}
+
+	// Frames whose queries were not available when their slot came round.
+	unsigned int dropped_frames() const
+	{
+		return _dropped;
+	}
+
+	// Forget every sample so far; queries in flight are discarded too.
+	void reset()
+	{
+		for (size_t i = 0; i < _scopes.size(); i++){
+			_scopes[i].samples.clear();
+			_scopes[i].next = 0;
+		}
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+			_frames[i].pending = false;
+		_dropped = 0;
+	}
+
+	void print_summary() const
+	{
+		printf("gpu time (ms, last %u frames max, %u dropped):\n", (unsigned int)_window, _dropped);
+		printf("  %-10s %8s %8s %8s %8s %8s\n", "scope", "min", "avg", "p95", "p99", "samples");
+		for (int i = 0; i < scope_count(); i++){
+			GpuTimerStats s = stats(i);
+			if (s.samples == 0)
+				continue;
+			printf("  %-10s %8.3f %8.3f %8.3f %8.3f %8u\n", _scopes[i].name.c_str(),
+				s.min_ms, s.avg_ms, s.p95_ms, s.p99_ms, s.samples);
+		}
+	}
+
+	void destory()
+	{
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++){
+			FrameSlot& slot = _frames[i];
+			if (!slot.queries.empty())
+				glDeleteQueries((GLsizei)slot.queries.size(), &slot.queries[0]);
+			slot.queries.clear();
+			slot.used.clear();
+			slot.pending = false;
+		}
+	}
+
+private:
+	enum { FRAME_SCOPE = 0 };
+
+	struct Scope
+	{
+		std::string name;
+		std::vector<double> samples;	// ring of the last _window results
+		size_t next = 0;
+		double latest_ms = 0.0;
+		unsigned int total = 0;
+	};
+
+	struct FrameSlot
+	{
+		std::vector<GLuint> queries;	// begin/end timestamp per scope
+		std::vector<char> used;
+		GLuint last_query = 0;
+		bool pending = false;
+	};
+
+	// Queries for scopes registered since the slot was last used.
+	void _Reserve(FrameSlot& slot)
+	{
+		size_t needed = _scopes.size() * 2;
+		size_t have = slot.queries.size();
+		if (have >= needed)
+			return;
+		slot.queries.resize(needed);
+		glGenQueries((GLsizei)(needed - have), &slot.queries[have]);
+	}
+
+	// Reads the slot's results if the GPU is done with them. Otherwise the
+	// frame is dropped, or with drop false left pending.
+	void _Collect(FrameSlot& slot, bool drop)
+	{
+		// timestamps complete in order, so the frame's last query decides
+		GLint available = 0;
+		glGetQueryObjectiv(slot.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available){
+			if (drop){
+				slot.pending = false;
+				_dropped++;
+			}
+			return;
+		}
+		slot.pending = false;
+		for (size_t i = 0; i < slot.used.size() && i < _scopes.size(); i++){
+			if (!slot.used[i])
+				continue;
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			_Push(_scopes[i], end > start ? (end - start) / 1.0e6 : 0.0);
+		}
+	}
+
+	void _Push(Scope& scope, double ms)
+	{
+		if (scope.samples.size() < _window)
+			scope.samples.push_back(ms);
+		else
+			scope.samples[scope.next] = ms;
+		scope.next = (scope.next + 1) % _window;
+		scope.latest_ms = ms;
+		scope.total++;
+	}
+
+	static double _Percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t rank = (size_t)(p * sorted.size() + 0.999999);
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+	size_t _window;
+	std::vector<Scope> _scopes;
+	FrameSlot _frames[FRAMES_IN_FLIGHT];
+	int _slot = 0;
+	unsigned int _dropped = 0;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+typedef unsigned long long hash64_t;
+
+#define FNV1A_64_INIT 0xcbf29ce484222325ULL
+
+// 64-bit FNV-1a. Pass the previous result as seed to hash several buffers
+// as one stream.
+inline hash64_t hash_fnv1a(const void* data, size_t size, hash64_t seed = FNV1A_64_INIT)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	hash64_t h = seed;
+	for (size_t i = 0; i < size; i++){
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+inline hash64_t hash_fnv1a(const std::string& str, hash64_t seed = FNV1A_64_INIT)
+{
+	// hash the terminator too, so ("ab","c") and ("a","bc") differ
+	return hash_fnv1a(str.c_str(), str.size() + 1, seed);
+}
+
+// Hash for large buffers such as whole model files. Four independent lanes
+// each fold in 8 bytes per step, which runs several times faster than the
+// byte-wise hash_fnv1a. The values differ from hash_fnv1a's.
+inline hash64_t hash_wide(const void* data, size_t size, hash64_t seed = FNV1A_64_INIT)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	hash64_t lanes[4] = { seed, seed + 1, seed + 2, seed + 3 };
+	size_t blocks = size / 32;
+	for (size_t i = 0; i < blocks; i++, p += 32){
+		for (int l = 0; l < 4; l++){
+			hash64_t w;
+			memcpy(&w, p + l * 8, 8);
+			hash64_t x = lanes[l] ^ w;
+			lanes[l] = ((x << 29) | (x >> 35)) * 0x9e3779b97f4a7c15ULL;
+		}
+	}
+	hash64_t h = hash_fnv1a(lanes, sizeof(lanes), seed);
+	h = hash_fnv1a(&size, sizeof(size), h);
+	return hash_fnv1a(p, size % 32, h);
+}
+
+inline std::string hash_to_string(hash64_t h)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string s(16, '0');
+	for (int i = 15; i >= 0; i--, h >>= 4)
+		s[i] = digits[h & 0xf];
+	return s;
+}
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glew.h>
+#include <stdio.h>
+
+// Linux render boxes without a display server get a surfaceless EGL context
+// (Mesa llvmpipe works); elsewhere a hidden GLFW window provides the context.
+#if defined(__linux__) && !defined(SHADERTOY_HEADLESS_GLFW)
+#define SHADERTOY_HEADLESS_EGL 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#define SHADERTOY_HEADLESS_EGL 0
+#include <GLFW/glfw3.h>
+#endif
+
+// OpenGL context without a visible surface. Everything is drawn into
+// framebuffer objects; there is no default framebuffer to present.
+class HeadlessContext
+{
+public:
+	HeadlessContext() {}
+
+	~HeadlessContext()
+	{
+		destory();
+	}
+
+	bool init(int major = 4, int minor = 5)
+	{
+#if SHADERTOY_HEADLESS_EGL
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display)
+			_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (_display == EGL_NO_DISPLAY)
+			_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		EGLint egl_major = 0, egl_minor = 0;
+		if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, &egl_major, &egl_minor)){
+			printf("Failed to initialize EGL\n");
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)){
+			printf("EGL has no desktop OpenGL support\n");
+			return false;
+		}
+		const EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config = NULL;
+		EGLint count = 0;
+		eglChooseConfig(_display, config_attribs, &config, 1, &count);
+		const EGLint context_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, major,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		// EGL_KHR_no_config_context: surfaceless contexts don't need a config
+		_context = eglCreateContext(_display, count > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, context_attribs);
+		if (_context == EGL_NO_CONTEXT || !eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)){
+			printf("Failed to create a surfaceless OpenGL %d.%d context (EGL error 0x%X)\n", major, minor, eglGetError());
+			return false;
+		}
+#else
+		if (!glfwInit()){
+			printf("Failed to initialize GLFW\n");
+			return false;
+		}
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		_window = glfwCreateWindow(16, 16, "ShaderToy (headless)", NULL, NULL);
+		if (_window == NULL){
+			printf("Failed to create a hidden OpenGL %d.%d window\n", major, minor);
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(_window);
+#endif
+		glewExperimental = true; // Needed for core profile
+		GLenum err = glewInit();
+		// glew probes GLX on Linux and reports that as an error under EGL even
+		// though the core entry points resolved fine
+		if (err != GLEW_OK && glCreateShader == NULL){
+			printf("Failed to initialize GLEW\n");
+			return false;
+		}
+		glGetError();
+		printf("headless context: %s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+		return true;
+	}
+
+	void destory()
+	{
+#if SHADERTOY_HEADLESS_EGL
+		if (_display != EGL_NO_DISPLAY){
+			eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (_context != EGL_NO_CONTEXT)
+				eglDestroyContext(_display, _context);
+			eglTerminate(_display);
+		}
+		_display = EGL_NO_DISPLAY;
+		_context = EGL_NO_CONTEXT;
+#else
+		if (_window){
+			glfwDestroyWindow(_window);
+			glfwTerminate();
+		}
+		_window = NULL;
+#endif
+	}
+
+private:
+#if SHADERTOY_HEADLESS_EGL
+	EGLDisplay _display = EGL_NO_DISPLAY;
+	EGLContext _context = EGL_NO_CONTEXT;
+#else
+	GLFWwindow* _window = NULL;
+#endif
+};
+
+// A second context sharing objects with the one current on the calling
+// thread, for work that should not run on the GL thread. init() on the GL
+// thread, then make_current() once on the worker thread, which keeps it.
+// Works for the EGL context above, and for GLFW windows where GLFW is
+// included first; init() fails for anything else.
+class SharedContext
+{
+public:
+	SharedContext() {}
+
+	~SharedContext()
+	{
+		destory();
+	}
+
+	bool init(int major = 4, int minor = 5)
+	{
+#if SHADERTOY_HEADLESS_EGL
+		EGLContext current = eglGetCurrentContext();
+		if (current != EGL_NO_CONTEXT){
+			_display = eglGetCurrentDisplay();
+			EGLint config_id = 0, count = 0;
+			EGLConfig config = NULL;
+			eglQueryContext(_display, current, EGL_CONFIG_ID, &config_id);
+			const EGLint config_attribs[] = { EGL_CONFIG_ID, config_id, EGL_NONE };
+			if (config_id != 0)
+				eglChooseConfig(_display, config_attribs, &config, 1, &count);
+			const EGLint context_attribs[] = {
+				EGL_CONTEXT_MAJOR_VERSION, major,
+				EGL_CONTEXT_MINOR_VERSION, minor,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+				EGL_NONE
+			};
+			_context = eglCreateContext(_display, count > 0 ? config : (EGLConfig)0, current, context_attribs);
+			return _context != EGL_NO_CONTEXT;
+		}
+#endif
+#ifdef GLFW_VERSION_MAJOR
+		GLFWwindow* current_window = glfwGetCurrentContext();
+		if (current_window != NULL){
+			glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+			glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+			_window = glfwCreateWindow(16, 16, "ShaderToy (shared)", NULL, current_window);
+			glfwDefaultWindowHints();
+			// glfwCreateWindow leaves the current context alone
+			return _window != NULL;
+		}
+#endif
+		return false;
+	}
+
+	bool make_current()
+	{
+#if SHADERTOY_HEADLESS_EGL
+		if (_context != EGL_NO_CONTEXT)
+			return eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context) == EGL_TRUE;
+#endif
+#ifdef GLFW_VERSION_MAJOR
+		if (_window != NULL){
+			glfwMakeContextCurrent(_window);
+			return true;
+		}
+#endif
+		return false;
+	}
+
+	// On the worker thread, before it ends.
+	void release_current()
+	{
+#if SHADERTOY_HEADLESS_EGL
+		if (_context != EGL_NO_CONTEXT)
+			eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+#ifdef GLFW_VERSION_MAJOR
+		if (_window != NULL)
+			glfwMakeContextCurrent(NULL);
+#endif
+	}
+
+	// On the GL thread, after the worker released it.
+	void destory()
+	{
+#if SHADERTOY_HEADLESS_EGL
+		if (_context != EGL_NO_CONTEXT)
+			eglDestroyContext(_display, _context);
+		_context = EGL_NO_CONTEXT;
+#endif
+#ifdef GLFW_VERSION_MAJOR
+		if (_window != NULL)
+			glfwDestroyWindow(_window);
+		_window = NULL;
+#endif
+	}
+
+private:
+#if SHADERTOY_HEADLESS_EGL
+	EGLDisplay _display = EGL_NO_DISPLAY;
+	EGLContext _context = EGL_NO_CONTEXT;
+#endif
+#ifdef GLFW_VERSION_MAJOR
+	GLFWwindow* _window = NULL;
+#endif
+};
+
+// Color target for offscreen rendering.
+class RenderTarget
+{
+public:
+	RenderTarget() {}
+
+	~RenderTarget()
+	{
+		destory();
+	}
+
+	void init(int width, int height, GLenum internal_format = GL_RGBA8)
+	{
+		destory();
+		_width = width;
+		_height = height;
+		glGenTextures(1, &_texture);
+		glBindTexture(GL_TEXTURE_2D, _texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenFramebuffers(1, &_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			printf("Render target %dx%d is incomplete\n", width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void destory()
+	{
+		if (_framebuffer) glDeleteFramebuffers(1, &_framebuffer);
+		if (_texture) glDeleteTextures(1, &_texture);
+		_framebuffer = _texture = 0;
+	}
+
+	GLuint framebuffer() const { return _framebuffer; }
+	GLuint texture() const { return _texture; }
+	int width() const { return _width; }
+	int height() const { return _height; }
+
+private:
+	GLuint _framebuffer = 0;
+	GLuint _texture = 0;
+	int _width = 0;
+	int _height = 0;
+};
+
+#endif
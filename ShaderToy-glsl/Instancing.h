@@ -0,0 +1,253 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <glew.h>
+#include <glm/glm.hpp>
+#include "MeshArena.h"
+
+// Shader storage binding of the instance array; see shader/instanced_vert.glsl.
+#define INSTANCE_DATA_BINDING 1
+// Vertex attribute carrying the instance's index into that array.
+#define INSTANCE_INDEX_LOCATION 7
+
+// One instance as the vertex shader sees it (std430).
+struct InstanceData
+{
+	glm::mat4 transform;
+	glm::vec4 params;
+};
+
+// Layout fixed by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+// Draws any number of instances of the meshes of a MeshArena with a single
+// glMultiDrawElementsIndirect: one command per mesh, whose instances sit
+// contiguously from base_instance in a shader storage buffer. The shader
+// finds its instance through an attribute with divisor 1 that reads an
+// index buffer at base_instance + gl_InstanceID, which works on GL 4.3
+// without ARB_shader_draw_parameters.
+//
+// Instances and commands are written into a persistently mapped ring of
+// RING_SIZE frames, fenced like ShaderToyInputsRing, so the CPU never waits
+// for the GPU to finish reading an earlier frame. A frame whose instances did
+// not change redraws from the last slot without copying anything.
+class InstanceBatch
+{
+public:
+	enum { RING_SIZE = 3 };
+
+	InstanceBatch()
+	{
+		for (int i = 0; i < RING_SIZE; i++)
+			_fences[i] = 0;
+	}
+
+	~InstanceBatch()
+	{
+		destory();
+	}
+
+	// max_instances bounds the instances of one frame; arena must be built
+	// and outlive the batch.
+	bool init(const MeshArena& arena, unsigned int max_instances)
+	{
+		destory();
+		if (!arena.ready() || max_instances == 0)
+			return false;
+		_arena = &arena;
+		_max_instances = max_instances;
+		_mesh_count = (unsigned int)arena.size();
+
+		GLint align = 256;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+		_instance_stride = ((GLsizeiptr)sizeof(InstanceData) * max_instances + align - 1) / align * align;
+		_command_stride = (GLsizeiptr)sizeof(DrawElementsIndirectCommand) * _mesh_count;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &_instance_buffer);
+		glNamedBufferStorage(_instance_buffer, _instance_stride * RING_SIZE, NULL, flags);
+		_mapped_instances = (char*)glMapNamedBufferRange(_instance_buffer, 0, _instance_stride * RING_SIZE, flags);
+		glCreateBuffers(1, &_command_buffer);
+		glNamedBufferStorage(_command_buffer, _command_stride * RING_SIZE, NULL, flags);
+		_mapped_commands = (char*)glMapNamedBufferRange(_command_buffer, 0, _command_stride * RING_SIZE, flags);
+		if (_mapped_instances == NULL || _mapped_commands == NULL){
+			printf("Failed to map the instance buffers\n");
+			destory();
+			return false;
+		}
+
+		// 0, 1, 2, ... read once per instance: base_instance offsets the fetch
+		std::vector<GLuint> indices(max_instances);
+		for (GLuint i = 0; i < max_instances; i++)
+			indices[i] = i;
+		glCreateBuffers(1, &_index_buffer);
+		glNamedBufferStorage(_index_buffer, (GLsizeiptr)(indices.size() * sizeof(GLuint)), &indices[0], 0);
+
+		glCreateVertexArrays(1, &_vertex_array);
+		arena.bind_to(_vertex_array);
+		glVertexArrayVertexBuffer(_vertex_array, 1, _index_buffer, 0, sizeof(GLuint));
+		glVertexArrayBindingDivisor(_vertex_array, 1, 1);
+		glEnableVertexArrayAttrib(_vertex_array, INSTANCE_INDEX_LOCATION);
+		glVertexArrayAttribIFormat(_vertex_array, INSTANCE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0);
+		glVertexArrayAttribBinding(_vertex_array, INSTANCE_INDEX_LOCATION, 1);
+
+		_per_mesh.assign(_mesh_count, 0);
+		clear();
+		return true;
+	}
+
+	void destory()
+	{
+		for (int i = 0; i < RING_SIZE; i++){
+			if (_fences[i]) glDeleteSync(_fences[i]);
+			_fences[i] = 0;
+		}
+		if (_instance_buffer){
+			glUnmapNamedBuffer(_instance_buffer);
+			glDeleteBuffers(1, &_instance_buffer);
+		}
+		if (_command_buffer){
+			glUnmapNamedBuffer(_command_buffer);
+			glDeleteBuffers(1, &_command_buffer);
+		}
+		if (_index_buffer)
+			glDeleteBuffers(1, &_index_buffer);
+		if (_vertex_array)
+			glDeleteVertexArrays(1, &_vertex_array);
+		_instance_buffer = _command_buffer = _index_buffer = _vertex_array = 0;
+		_mapped_instances = _mapped_commands = NULL;
+		_arena = NULL;
+		_uploaded = false;
+	}
+
+	// Drop every instance.
+	void clear()
+	{
+		_instances.clear();
+		_meshes.clear();
+		_dirty = true;
+	}
+
+	// Add an instance of arena mesh `mesh`; returns its handle for set(), or
+	// -1 once max_instances is reached.
+	int add(int mesh, const glm::mat4& transform, const glm::vec4& params = glm::vec4(0.0f))
+	{
+		if (_instances.size() >= _max_instances || mesh < 0 || (unsigned int)mesh >= _mesh_count)
+			return -1;
+		InstanceData instance;
+		instance.transform = transform;
+		instance.params = params;
+		_instances.push_back(instance);
+		_meshes.push_back((unsigned int)mesh);
+		_dirty = true;
+		return (int)_instances.size() - 1;
+	}
+
+	void set(int handle, const glm::mat4& transform, const glm::vec4& params)
+	{
+		_instances[handle].transform = transform;
+		_instances[handle].params = params;
+		_dirty = true;
+	}
+
+	// Draw every instance with the program in use: five GL calls (six when
+	// nothing changed, to move the fence), whatever the number of instances
+	// and meshes.
+	void render()
+	{
+		if (_vertex_array == 0 || _instances.empty())
+			return;
+		if (_dirty || !_uploaded){
+			_slot = (_slot + 1) % RING_SIZE;
+			_WaitFence(_slot);
+			_Write((InstanceData*)(_mapped_instances + _instance_stride * _slot),
+				(DrawElementsIndirectCommand*)(_mapped_commands + _command_stride * _slot));
+			_dirty = false;
+			_uploaded = true;
+		}
+		else if (_fences[_slot]){
+			glDeleteSync(_fences[_slot]);
+			_fences[_slot] = 0;
+		}
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, _instance_buffer, _instance_stride * _slot, (GLsizeiptr)sizeof(InstanceData) * _instances.size());
+		glBindVertexArray(_vertex_array);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _command_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, _arena->index_type(), (void*)(_command_stride * _slot), (GLsizei)_mesh_count, 0);
+		_fences[_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	size_t size() const
+	{
+		return _instances.size();
+	}
+
+private:
+	// Group the instances by mesh (a counting sort straight into the mapped
+	// slot) and write one command per mesh. Meshes without instances keep a
+	// command with instance_count 0, so the command count never changes.
+	void _Write(InstanceData* instances, DrawElementsIndirectCommand* commands)
+	{
+		std::fill(_per_mesh.begin(), _per_mesh.end(), 0u);
+		for (size_t i = 0; i < _meshes.size(); i++)
+			_per_mesh[_meshes[i]]++;
+		GLuint base = 0;
+		for (unsigned int m = 0; m < _mesh_count; m++){
+			const ArenaMesh& mesh = _arena->mesh((int)m);
+			DrawElementsIndirectCommand command;
+			command.count = mesh.index_count;
+			command.instance_count = _per_mesh[m];
+			command.first_index = mesh.first_index;
+			command.base_vertex = (GLint)mesh.base_vertex;
+			command.base_instance = base;
+			memcpy(&commands[m], &command, sizeof(command));
+			_per_mesh[m] = base;
+			base += command.instance_count;
+		}
+		for (size_t i = 0; i < _instances.size(); i++)
+			memcpy(&instances[_per_mesh[_meshes[i]]++], &_instances[i], sizeof(InstanceData));
+	}
+
+	void _WaitFence(int slot)
+	{
+		if (!_fences[slot])
+			return;
+		GLenum r = glClientWaitSync(_fences[slot], 0, 0);
+		while (r == GL_TIMEOUT_EXPIRED)
+			r = glClientWaitSync(_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(_fences[slot]);
+		_fences[slot] = 0;
+	}
+
+	const MeshArena* _arena = NULL;
+	unsigned int _max_instances = 0;
+	unsigned int _mesh_count = 0;
+	std::vector<InstanceData> _instances;
+	std::vector<unsigned int> _meshes;
+	std::vector<unsigned int> _per_mesh;
+	bool _dirty = true;
+	bool _uploaded = false;
+
+	GLuint _vertex_array = 0;
+	GLuint _index_buffer = 0;
+	GLuint _instance_buffer = 0;
+	GLuint _command_buffer = 0;
+	GLsizeiptr _instance_stride = 0;
+	GLsizeiptr _command_stride = 0;
+	char* _mapped_instances = NULL;
+	char* _mapped_commands = NULL;
+	int _slot = RING_SIZE - 1;
+	GLsync _fences[RING_SIZE];
+};
+
+#endif
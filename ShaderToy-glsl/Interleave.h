@@ -0,0 +1,114 @@
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <stdio.h>
+#include "FullscreenTriangle.h"
+#include "Shader.h"
+#include "RenderGraph.h"
+#include "Headless.h"
+
+// Checkerboard (n = 2) or n-way interleaved rendering of a single-pass
+// shader. Each frame the shader only runs for every nth pixel of each row,
+// into a target 1/n as wide as the output; the pattern shifts by one column
+// per row and per frame. A resolve pass rebuilds the full frame from those
+// pixels and a history of earlier resolved frames, which the framework keeps
+// in two ping-ponged targets, so shaders need no changes.
+class InterleavedRenderer
+{
+public:
+	InterleavedRenderer() {}
+
+	bool init(int width, int height, int n)
+	{
+		_n = n;
+		_width = width;
+		_height = height;
+		_current.init((width + n - 1) / n, height);
+		for (int i = 0; i < 2; i++)
+			_history[i].init(width, height);
+		_resolve.init("shader/fullscreen_vert.glsl", "shader/interleave_resolve_frag.glsl", false);
+		_u_current = _resolve.uniform<Sampler>("current");
+		_u_history = _resolve.uniform<Sampler>("history");
+		_u_interleave = _resolve.uniform<glm::vec2>("interleave");
+		_u_has_history = _resolve.uniform<bool>("has_history");
+		reset();
+		return _resolve.ready();
+	}
+
+	// Route graph's Image pass into the interleaved target. Graphs with buffer
+	// passes are refused: a buffer read by texture coordinate would need to be
+	// rebuilt too.
+	bool attach(RenderGraph& graph)
+	{
+		if (graph.order().size() != 1 || graph.has_feedback()){
+			printf("Interleaved rendering needs a single-pass shader\n");
+			return false;
+		}
+		// a no-op when the graph was loaded with it already
+		graph.set_frag_coord_remap(true);
+		graph.set_output(_current.framebuffer());
+		graph.resize(_current.width(), _current.height());
+		reset();
+		return true;
+	}
+
+	// Select this frame's pixels. Call before the graph renders.
+	void begin_frame(RenderGraph& graph, int frame)
+	{
+		_phase = frame % _n;
+		graph.set_interleave(_n, _phase);
+	}
+
+	// Rebuild the full frame into framebuffer (0 is the window).
+	void resolve(FullscreenTriangle& quad, GLuint framebuffer = 0)
+	{
+		int write = 1 - _read;
+		glBindFramebuffer(GL_FRAMEBUFFER, _history[write].framebuffer());
+		glViewport(0, 0, _width, _height);
+		_resolve.use();
+		_resolve.set(_u_current, _current.texture(), 0);
+		_resolve.set(_u_history, _history[_read].texture(), 1);
+		_resolve.set(_u_interleave, glm::vec2((float)_n, (float)_phase));
+		_resolve.set(_u_has_history, _has_history);
+		quad.render();
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, _history[write].framebuffer());
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+		glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		_read = write;
+		_has_history = true;
+	}
+
+	// Forget the history, e.g. after switching shaders or a reload.
+	void reset()
+	{
+		_has_history = false;
+	}
+
+	void destory()
+	{
+		_current.destory();
+		_history[0].destory();
+		_history[1].destory();
+	}
+
+private:
+	int _n = 2;
+	int _phase = 0;
+	int _width = 0;
+	int _height = 0;
+	int _read = 0;
+	bool _has_history = false;
+	RenderTarget _current;
+	RenderTarget _history[2];
+	Shader _resolve;
+	Uniform<Sampler> _u_current;
+	Uniform<Sampler> _u_history;
+	Uniform<glm::vec2> _u_interleave;
+	Uniform<bool> _u_has_history;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are read on first touch,
+// so data() can be handed straight to the driver without a copy through a
+// std::vector. Empty files can't be mapped and fail to open.
+class MappedFile
+{
+public:
+	MappedFile() {}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (_file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0){
+			close();
+			return false;
+		}
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (_mapping == NULL){
+			close();
+			return false;
+		}
+		_data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		_size = (size_t)size.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0){
+			::close(fd);
+			return false;
+		}
+		void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return false;
+		_data = data;
+		_size = (size_t)st.st_size;
+#endif
+		if (_data == NULL){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (_data != NULL)
+			UnmapViewOfFile(_data);
+		if (_mapping != NULL)
+			CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE)
+			CloseHandle(_file);
+		_mapping = NULL;
+		_file = INVALID_HANDLE_VALUE;
+#else
+		if (_data != NULL)
+			munmap(_data, _size);
+#endif
+		_data = NULL;
+		_size = 0;
+	}
+
+	bool is_open() const
+	{
+		return _data != NULL;
+	}
+
+	const void* data() const
+	{
+		return _data;
+	}
+
+	// Let the OS take the pages of [offset, offset + size) out of this
+	// process's resident set once they have been used, e.g. uploaded. The
+	// file stays mapped, and touching the range again reads it back from the
+	// file cache. Only whole pages inside the range are dropped.
+	void release(size_t offset, size_t size) const
+	{
+		size_t page = _PageSize();
+		size_t first = (offset + page - 1) / page * page;
+		size_t last = std::min(offset + size, _size) / page * page;
+		if (_data == NULL || last <= first)
+			return;
+#ifdef _WIN32
+		// unlocking pages that are not locked removes them from the working set
+		VirtualUnlock((char*)_data + first, last - first);
+#else
+		madvise((char*)_data + first, last - first, MADV_DONTNEED);
+#endif
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	static size_t _PageSize()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	void* _data = NULL;
+	size_t _size = 0;
+#ifdef _WIN32
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = NULL;
+#endif
+};
+
+#endif
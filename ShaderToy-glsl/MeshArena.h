@@ -0,0 +1,184 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <glew.h>
+#include "Model.h"
+
+// Where one mesh lives inside a MeshArena, in the units of
+// DrawElementsIndirectCommand: first_index counts indices, base_vertex
+// vertices.
+struct ArenaMesh
+{
+	unsigned int index_count = 0;
+	unsigned int first_index = 0;
+	unsigned int vertex_count = 0;
+	unsigned int base_vertex = 0;
+};
+
+// Many meshes of one vertex layout packed into a single vertex buffer and a
+// single index buffer, so they can all be drawn by one multi-draw call. Each
+// mesh keeps its own 0-based indices; draws offset them by base_vertex.
+// Meshes are added on the CPU side, then build() uploads everything at once
+// into immutable buffers. Indices are 16-bit when every mesh allows it.
+class MeshArena
+{
+public:
+	MeshArena() {}
+
+	~MeshArena()
+	{
+		destory();
+	}
+
+	// Layout flags as in Model::init(); every mesh is loaded with them.
+	void init(bool use_normal = true, bool use_uv = true, bool use_tangent = false, bool use_bitangent = false)
+	{
+		destory();
+		_use_normal = use_normal;
+		_use_uv = use_uv;
+		_use_tangent = use_tangent;
+		_use_bitangent = use_bitangent;
+		_stride = 0;
+		_vertices.clear();
+		_indices.clear();
+		_meshes.clear();
+	}
+
+	// Load a model file through Model::prepare(), so the mesh cache and the
+	// optimizer apply as for a Model. Returns the mesh id, or -1.
+	int add(const std::string& path, bool optimize = false)
+	{
+		Model loader;
+		loader.set_optimize(optimize);
+		MeshImport import;
+		if (!loader.prepare(path, import, _use_normal, _use_uv, _use_tangent, _use_bitangent) || import.mesh.vertices == NULL){
+			printf("Mesh arena: could not load %s\n", path.c_str());
+			return -1;
+		}
+		return add(import.mesh);
+	}
+
+	// Copy a mesh already in the arena's layout. Call before build().
+	int add(const MeshData& mesh)
+	{
+		if (_stride == 0)
+			_stride = mesh.stride;
+		if (mesh.stride != _stride || mesh.vertex_count == 0 || mesh.index_count == 0){
+			printf("Mesh arena: mesh with stride %u does not fit the arena layout (stride %u)\n", mesh.stride, _stride);
+			return -1;
+		}
+		ArenaMesh placed;
+		placed.index_count = mesh.index_count;
+		placed.first_index = (unsigned int)_indices.size();
+		placed.vertex_count = mesh.vertex_count;
+		placed.base_vertex = (unsigned int)(_vertices.size() / _stride);
+
+		const char* vertices = (const char*)mesh.vertices;
+		_vertices.insert(_vertices.end(), vertices, vertices + (size_t)mesh.vertex_count * mesh.stride);
+		_indices.resize(_indices.size() + mesh.index_count);
+		unsigned int* indices = &_indices[placed.first_index];
+		if (mesh.index_size == 2){
+			const unsigned short* source = (const unsigned short*)mesh.indices;
+			for (unsigned int i = 0; i < mesh.index_count; i++)
+				indices[i] = source[i];
+		}
+		else
+			memcpy(indices, mesh.indices, (size_t)mesh.index_count * sizeof(unsigned int));
+		_meshes.push_back(placed);
+		return (int)_meshes.size() - 1;
+	}
+
+	// Upload every mesh added so far and release the CPU copies. Returns false
+	// if the arena is empty.
+	bool build()
+	{
+		if (_meshes.empty())
+			return false;
+		_index_type = GL_UNSIGNED_SHORT;
+		for (size_t i = 0; i < _meshes.size(); i++)
+			if (_meshes[i].vertex_count > 65536)
+				_index_type = GL_UNSIGNED_INT;
+
+		glCreateBuffers(1, &_vertex_buffer);
+		glNamedBufferStorage(_vertex_buffer, (GLsizeiptr)_vertices.size(), &_vertices[0], 0);
+		glCreateBuffers(1, &_element_buffer);
+		if (_index_type == GL_UNSIGNED_SHORT){
+			std::vector<unsigned short> indices16(_indices.begin(), _indices.end());
+			glNamedBufferStorage(_element_buffer, (GLsizeiptr)(indices16.size() * sizeof(unsigned short)), &indices16[0], 0);
+		}
+		else
+			glNamedBufferStorage(_element_buffer, (GLsizeiptr)(_indices.size() * sizeof(unsigned int)), &_indices[0], 0);
+
+		_vertex_bytes = _vertices.size();
+		_index_count = _indices.size();
+		std::vector<char>().swap(_vertices);
+		std::vector<unsigned int>().swap(_indices);
+		return true;
+	}
+
+	// Point binding 0 and the element buffer of vertex_array at the arena and
+	// describe the layout; returns the number of attributes used, so callers
+	// can put their own attributes after them.
+	GLuint bind_to(GLuint vertex_array) const
+	{
+		glVertexArrayVertexBuffer(vertex_array, 0, _vertex_buffer, 0, (GLsizei)_stride);
+		glVertexArrayElementBuffer(vertex_array, _element_buffer);
+		return Model::set_vertex_format(vertex_array, _use_normal, _use_uv, _use_tangent, _use_bitangent);
+	}
+
+	void destory()
+	{
+		if (_vertex_buffer != 0)
+			glDeleteBuffers(1, &_vertex_buffer);
+		if (_element_buffer != 0)
+			glDeleteBuffers(1, &_element_buffer);
+		_vertex_buffer = _element_buffer = 0;
+	}
+
+	bool ready() const
+	{
+		return _vertex_buffer != 0;
+	}
+
+	size_t size() const
+	{
+		return _meshes.size();
+	}
+
+	const ArenaMesh& mesh(int id) const
+	{
+		return _meshes[id];
+	}
+
+	GLenum index_type() const
+	{
+		return _index_type;
+	}
+
+	// GPU bytes of both buffers once built.
+	size_t bytes() const
+	{
+		return _vertex_bytes + _index_count * (_index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+
+private:
+	bool _use_normal = true;
+	bool _use_uv = true;
+	bool _use_tangent = false;
+	bool _use_bitangent = false;
+	unsigned int _stride = 0;
+	std::vector<char> _vertices;
+	std::vector<unsigned int> _indices;
+	std::vector<ArenaMesh> _meshes;
+	GLuint _vertex_buffer = 0;
+	GLuint _element_buffer = 0;
+	GLenum _index_type = GL_UNSIGNED_INT;
+	size_t _vertex_bytes = 0;
+	size_t _index_count = 0;
+};
+
+#endif
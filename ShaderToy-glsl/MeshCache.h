@@ -0,0 +1,206 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include "Hash.h"
+#include "FileUtil.h"
+#include "MappedFile.h"
+
+struct MeshCacheStats
+{
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	unsigned int stores = 0;
+	double import_ms_saved = 0.0;
+};
+
+// Vertex and index streams exactly as uploaded: stride bytes per interleaved
+// vertex and index_size (2 or 4) bytes per index. On a cache hit the
+// pointers point into the mapped entry.
+struct MeshData
+{
+	const void* vertices = NULL;
+	const void* indices = NULL;
+	unsigned int vertex_count = 0;
+	unsigned int index_count = 0;
+	unsigned int stride = 0;
+	unsigned int index_size = 4;
+};
+
+// On-disk cache of imported meshes. An entry is a fixed header followed by
+// the vertex stream and the index stream, so a warm load maps the file and
+// uploads from the mapping without parsing anything. Entries are keyed by
+// the source file's contents plus the vertex layout and import flags; any
+// edit to the model or a different Model::init() configuration misses.
+// Like ProgramCache, entries are written to a temporary file and renamed
+// into place. key(), load() and store() may be called from several threads.
+class MeshCache
+{
+public:
+	static MeshCache& instance()
+	{
+		static MeshCache cache;
+		return cache;
+	}
+
+	void set_directory(const std::string& dir)
+	{
+		_dir = dir;
+		_dir_created = false;
+	}
+
+	void set_enabled(bool enabled)
+	{
+		_enabled = enabled;
+	}
+
+	bool enabled() const
+	{
+		return _enabled;
+	}
+
+	// Hashes source_path's contents with the layout and import flags.
+	// Returns 0 when the cache is off or the source can't be read.
+	hash64_t key(const std::string& source_path, unsigned int layout, unsigned int import_flags) const
+	{
+		if (!_enabled)
+			return 0;
+		MappedFile source;
+		if (!source.open(source_path))
+			return 0;
+		unsigned int version = ENTRY_VERSION;
+		hash64_t h = hash_wide(source.data(), source.size());
+		h = hash_fnv1a(&version, sizeof(version), h);
+		h = hash_fnv1a(&layout, sizeof(layout), h);
+		h = hash_fnv1a(&import_flags, sizeof(import_flags), h);
+		return h;
+	}
+
+	// Maps the entry for key into file and points mesh at its streams. Fails
+	// on a miss, a damaged entry or a stride other than the expected one.
+	bool load(hash64_t key, unsigned int stride, MappedFile& file, MeshData& mesh)
+	{
+		if (key == 0)
+			return false;
+		if (!file.open(_EntryPath(key))){
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stats.misses++;
+			return false;
+		}
+		const EntryHeader* header = (const EntryHeader*)file.data();
+		bool ok = file.size() >= sizeof(EntryHeader) &&
+			header->magic == ENTRY_MAGIC && header->version == ENTRY_VERSION &&
+			header->key == key && header->stride == stride &&
+			(header->index_size == 2 || header->index_size == 4) &&
+			file.size() == sizeof(EntryHeader) + (size_t)header->vertex_count * stride + (size_t)header->index_count * header->index_size;
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!ok){
+			file.close();
+			_stats.misses++;
+			return false;
+		}
+		const char* base = (const char*)file.data() + sizeof(EntryHeader);
+		mesh.vertices = base;
+		mesh.indices = base + (size_t)header->vertex_count * stride;
+		mesh.vertex_count = header->vertex_count;
+		mesh.index_count = header->index_count;
+		mesh.stride = stride;
+		mesh.index_size = header->index_size;
+		_stats.hits++;
+		_stats.import_ms_saved += header->import_ms;
+		return true;
+	}
+
+	// Writes mesh under key. import_ms is the time the import took, recorded
+	// so later hits can report savings.
+	void store(hash64_t key, const MeshData& mesh, double import_ms)
+	{
+		if (key == 0 || !_EnsureDirectory())
+			return;
+		EntryHeader header;
+		header.magic = ENTRY_MAGIC;
+		header.version = ENTRY_VERSION;
+		header.key = key;
+		header.stride = mesh.stride;
+		header.vertex_count = mesh.vertex_count;
+		header.index_count = mesh.index_count;
+		header.index_size = mesh.index_size;
+		header.import_ms = import_ms;
+
+		static std::atomic<unsigned int> counter(0);
+		char suffix[64];
+		sprintf(suffix, ".%d.%u.tmp", process_id(), counter++);
+		std::string path = _EntryPath(key);
+		std::string tmp_path = path + suffix;
+		FILE* fp = fopen(tmp_path.c_str(), "wb");
+		if (fp == NULL)
+			return;
+		size_t vertex_bytes = (size_t)mesh.vertex_count * mesh.stride;
+		bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			fwrite(mesh.vertices, 1, vertex_bytes, fp) == vertex_bytes &&
+			fwrite(mesh.indices, mesh.index_size, mesh.index_count, fp) == mesh.index_count;
+		ok = fclose(fp) == 0 && ok;
+		if (!ok || !replace_file(tmp_path, path)){
+			remove(tmp_path.c_str());
+			return;
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.stores++;
+	}
+
+	const MeshCacheStats& stats() const
+	{
+		return _stats;
+	}
+
+	void print_stats() const
+	{
+		printf("mesh cache: %u hits, %u misses, %u stored, %.1f ms import time saved\n",
+			_stats.hits, _stats.misses, _stats.stores, _stats.import_ms_saved);
+	}
+
+private:
+	enum { ENTRY_MAGIC = 0x434d5453 /* "STMC" */, ENTRY_VERSION = 2 };
+
+	// 40 bytes, so the vertex stream that follows stays 8-byte aligned.
+	struct EntryHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		hash64_t key;
+		unsigned int stride;
+		unsigned int vertex_count;
+		unsigned int index_count;
+		unsigned int index_size;
+		double import_ms;
+	};
+
+	MeshCache() {}
+
+	std::string _EntryPath(hash64_t key) const
+	{
+		return _dir + "/" + hash_to_string(key) + ".mesh";
+	}
+
+	bool _EnsureDirectory()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_dir_created)
+			return true;
+		_dir_created = make_directory(_dir);
+		if (!_dir_created)
+			printf("Can not create mesh cache directory %s\n", _dir.c_str());
+		return _dir_created;
+	}
+
+	std::string _dir = "mesh_cache";
+	bool _dir_created = false;
+	bool _enabled = true;
+	MeshCacheStats _stats;
+	std::mutex _mutex;
+};
+
+#endif
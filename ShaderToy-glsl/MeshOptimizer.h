@@ -0,0 +1,319 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Triangle and vertex reordering for indexed triangle lists. The usual order
+// of use after an import is
+//   optimize_vertex_cache -> optimize_overdraw -> optimize_vertex_fetch
+// since overdraw sorting keeps clusters of the cache-optimized order intact
+// and the fetch remap only renumbers vertices.
+
+struct VertexCacheStats
+{
+	unsigned int transformed = 0;	// vertex shader invocations
+	float acmr = 0.0f;				// transformed vertices per triangle, 0.5 - 3
+	float atvr = 0.0f;				// transformed vertices per vertex used, 1 is ideal
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries, the model most
+// GPUs come close to.
+inline VertexCacheStats analyze_vertex_cache(const unsigned int* indices, size_t index_count, size_t vertex_count, unsigned int cache_size = 16)
+{
+	VertexCacheStats stats;
+	if (index_count < 3)
+		return stats;
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	std::vector<bool> used(vertex_count, false);
+	unsigned int time = cache_size + 1;
+	size_t unique = 0;
+	for (size_t i = 0; i < index_count; i++){
+		unsigned int v = indices[i];
+		if (time - timestamps[v] > cache_size){
+			timestamps[v] = time++;
+			stats.transformed++;
+		}
+		if (!used[v]){
+			used[v] = true;
+			unique++;
+		}
+	}
+	stats.acmr = (float)stats.transformed / (float)(index_count / 3);
+	stats.atvr = unique > 0 ? (float)stats.transformed / (float)unique : 0.0f;
+	return stats;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization. Triangles are
+// emitted greedily by a score that favours vertices recently used, in a
+// simulated LRU cache, and vertices with few triangles left, so that
+// isolated triangles don't get stranded. The simulated cache holds 16
+// entries; on grid-like meshes that scored better in analyze_vertex_cache()
+// than the 32 of the original paper. dest may alias indices.
+inline void optimize_vertex_cache(unsigned int* dest, const unsigned int* indices, size_t index_count, size_t vertex_count)
+{
+	const int CACHE_SIZE = 16;
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	// triangles using each vertex
+	std::vector<unsigned int> offsets(vertex_count + 1, 0);
+	for (size_t i = 0; i < triangle_count * 3; i++)
+		offsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertex_count; v++)
+		offsets[v + 1] += offsets[v];
+	std::vector<unsigned int> adjacency(triangle_count * 3);
+	std::vector<unsigned int> remaining(vertex_count, 0);
+	for (size_t t = 0; t < triangle_count; t++)
+		for (int k = 0; k < 3; k++){
+			unsigned int v = indices[t * 3 + k];
+			adjacency[offsets[v] + remaining[v]++] = (unsigned int)t;
+		}
+
+	struct Score
+	{
+		static float vertex(int cache_position, unsigned int live)
+		{
+			if (live == 0)
+				return -1.0f;
+			float score = 0.0f;
+			if (cache_position >= 0){
+				if (cache_position < 3)
+					score = 0.75f;		// used by the last triangle
+				else
+					score = powf(1.0f - (float)(cache_position - 3) / (CACHE_SIZE - 3), 1.5f);
+			}
+			return score + 2.0f / sqrtf((float)live);
+		}
+	};
+
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++)
+		vertex_score[v] = Score::vertex(-1, remaining[v]);
+	std::vector<float> triangle_score(triangle_count);
+	for (size_t t = 0; t < triangle_count; t++)
+		triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+	std::vector<bool> emitted(triangle_count, false);
+
+	std::vector<unsigned int> output(triangle_count * 3);
+	unsigned int cache[CACHE_SIZE + 3];
+	int cache_count = 0;
+	size_t input_cursor = 0;
+	long long best = -1;
+	for (size_t out = 0; out < triangle_count; out++){
+		if (best < 0){
+			// nothing adjacent to the cache: resume in input order
+			while (emitted[input_cursor])
+				input_cursor++;
+			best = (long long)input_cursor;
+		}
+		size_t t = (size_t)best;
+		emitted[t] = true;
+		const unsigned int* tri = &indices[t * 3];
+		output[out * 3] = tri[0];
+		output[out * 3 + 1] = tri[1];
+		output[out * 3 + 2] = tri[2];
+
+		// the triangle's vertices move to the front of the cache
+		unsigned int next_cache[CACHE_SIZE + 3];
+		int next_count = 0;
+		for (int k = 0; k < 3; k++){
+			if (k == 0 || (tri[k] != tri[0] && tri[k] != tri[1]))
+				next_cache[next_count++] = tri[k];
+			unsigned int* list = &adjacency[offsets[tri[k]]];
+			unsigned int live = remaining[tri[k]];
+			for (unsigned int i = 0; i < live; i++)
+				if (list[i] == t){
+					list[i] = list[live - 1];
+					break;
+				}
+			remaining[tri[k]]--;
+		}
+		for (int i = 0; i < cache_count; i++){
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				next_cache[next_count++] = v;
+		}
+
+		// rescore cached and evicted vertices and their live triangles, then
+		// pick the best triangle touching the cache
+		for (int i = 0; i < next_count; i++){
+			unsigned int v = next_cache[i];
+			float score = Score::vertex(i < CACHE_SIZE ? i : -1, remaining[v]);
+			float delta = score - vertex_score[v];
+			vertex_score[v] = score;
+			const unsigned int* list = &adjacency[offsets[v]];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+				triangle_score[list[a]] += delta;
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for (int i = 0; i < next_count && i < CACHE_SIZE; i++){
+			unsigned int v = next_cache[i];
+			const unsigned int* list = &adjacency[offsets[v]];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+				if (triangle_score[list[a]] > best_score){
+					best_score = triangle_score[list[a]];
+					best = list[a];
+				}
+		}
+		cache_count = std::min(next_count, CACHE_SIZE);
+		memcpy(cache, next_cache, cache_count * sizeof(unsigned int));
+	}
+	memcpy(dest, &output[0], output.size() * sizeof(unsigned int));
+}
+
+// Reorders the clusters of a cache-optimized index buffer so triangles
+// likely to occlude others are drawn first (Sander et al., "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw"). Clusters end where
+// the simulated cache restarts, and are split further as long as the pieces
+// keep their ACMR within threshold of the whole, so the vertex cache gain
+// survives. Clusters facing away from the mesh centre go first. positions
+// holds xyz at the start of each stride_floats-float vertex. dest may alias
+// indices.
+inline void optimize_overdraw(unsigned int* dest, const unsigned int* indices, size_t index_count,
+	const float* positions, size_t vertex_count, size_t stride_floats, float threshold = 1.05f)
+{
+	const unsigned int CACHE_SIZE = 16;
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	// cache misses of each triangle, and hard boundaries where all three miss
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	unsigned int time = CACHE_SIZE + 1;
+	std::vector<unsigned int> misses(triangle_count);
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangle_count; t++){
+		unsigned int m = 0;
+		for (int k = 0; k < 3; k++){
+			unsigned int v = indices[t * 3 + k];
+			if (time - timestamps[v] > CACHE_SIZE){
+				timestamps[v] = time++;
+				m++;
+			}
+		}
+		misses[t] = m;
+		if (m == 3 || t == 0)
+			hard.push_back(t);
+	}
+	hard.push_back(triangle_count);
+
+	// soft boundaries: start a new cluster once the running ACMR, with the
+	// cache reset at each cluster start, is within threshold of the whole
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++){
+		size_t start = hard[h], end = hard[h + 1];
+		unsigned int total = 0;
+		for (size_t t = start; t < end; t++)
+			total += misses[t];
+		float limit = (float)total / (float)(end - start) * threshold;
+		clusters.push_back(start);
+		time += CACHE_SIZE + 1;
+		unsigned int running = 0;
+		size_t sub = start;
+		for (size_t t = start; t < end; t++){
+			for (int k = 0; k < 3; k++){
+				unsigned int v = indices[t * 3 + k];
+				if (time - timestamps[v] > CACHE_SIZE){
+					timestamps[v] = time++;
+					running++;
+				}
+			}
+			if (t + 1 < end && (float)running / (float)(t + 1 - sub) <= limit){
+				clusters.push_back(t + 1);
+				time += CACHE_SIZE + 1;
+				running = 0;
+				sub = t + 1;
+			}
+		}
+	}
+	clusters.push_back(triangle_count);
+
+	// area-weighted centroid and normal per cluster
+	struct Cluster { size_t start; size_t end; float sort_key; };
+	std::vector<Cluster> sorted(clusters.size() - 1);
+	std::vector<float> centroids(sorted.size() * 3), normals(sorted.size() * 3);
+	float mesh_centroid[3] = { 0.0f, 0.0f, 0.0f };
+	float mesh_area = 0.0f;
+	for (size_t c = 0; c < sorted.size(); c++){
+		float* centroid = &centroids[c * 3];
+		float* normal = &normals[c * 3];
+		centroid[0] = centroid[1] = centroid[2] = 0.0f;
+		normal[0] = normal[1] = normal[2] = 0.0f;
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++){
+			const float* a = &positions[indices[t * 3] * stride_floats];
+			const float* b = &positions[indices[t * 3 + 1] * stride_floats];
+			const float* p = &positions[indices[t * 3 + 2] * stride_floats];
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float twice_area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; k++){
+				centroid[k] += (a[k] + b[k] + p[k]) / 3.0f * twice_area;
+				normal[k] += n[k];
+			}
+			area += twice_area;
+		}
+		for (int k = 0; k < 3; k++){
+			mesh_centroid[k] += centroid[k];
+			centroid[k] = area > 0.0f ? centroid[k] / area : 0.0f;
+		}
+		mesh_area += area;
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int k = 0; k < 3; k++)
+			normal[k] = length > 0.0f ? normal[k] / length : 0.0f;
+		sorted[c].start = clusters[c];
+		sorted[c].end = clusters[c + 1];
+	}
+	for (int k = 0; k < 3; k++)
+		mesh_centroid[k] = mesh_area > 0.0f ? mesh_centroid[k] / mesh_area : 0.0f;
+	for (size_t c = 0; c < sorted.size(); c++){
+		const float* centroid = &centroids[c * 3];
+		const float* normal = &normals[c * 3];
+		sorted[c].sort_key = (centroid[0] - mesh_centroid[0]) * normal[0] +
+			(centroid[1] - mesh_centroid[1]) * normal[1] + (centroid[2] - mesh_centroid[2]) * normal[2];
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b){ return a.sort_key > b.sort_key; });
+
+	std::vector<unsigned int> output;
+	output.reserve(triangle_count * 3);
+	for (size_t c = 0; c < sorted.size(); c++)
+		output.insert(output.end(), indices + sorted[c].start * 3, indices + sorted[c].end * 3);
+	memcpy(dest, &output[0], output.size() * sizeof(unsigned int));
+}
+
+// Renumbers vertices in order of first use, so vertex fetch walks memory
+// forward. Rewrites indices in place and fills remap[old] = new, ~0u for
+// vertices no triangle uses. Returns the number of vertices still used.
+inline size_t optimize_vertex_fetch(std::vector<unsigned int>& remap, unsigned int* indices, size_t index_count, size_t vertex_count)
+{
+	remap.assign(vertex_count, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < index_count; i++){
+		unsigned int& r = remap[indices[i]];
+		if (r == ~0u)
+			r = next++;
+		indices[i] = r;
+	}
+	return next;
+}
+
+// Applies a remap from optimize_vertex_fetch to one vertex stream.
+template <typename T>
+inline void remap_vertices(std::vector<T>& stream, const std::vector<unsigned int>& remap, size_t used)
+{
+	if (stream.empty())
+		return;
+	std::vector<T> result(used);
+	for (size_t v = 0; v < remap.size(); v++)
+		if (remap[v] != ~0u)
+			result[remap[v]] = stream[v];
+	stream.swap(result);
+}
+
+#endif
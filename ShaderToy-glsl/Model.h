@@ -18,8 +18,11 @@
 #include <assimp/postprocess.h>
 #endif
 
-#include <io.h> // _access
+#include <chrono>
 #include <glew.h>
+#include "FileUtil.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 
 
 using glm::vec3;
@@ -28,6 +31,19 @@ using glm::vec4;
 using namespace std;
 
 
+// CPU half of a model load: what Model::prepare() produced for
+// Model::upload(). The streams point either into vertices and the model's
+// own index array after an import, or into the mapped mesh cache entry.
+struct MeshImport
+{
+	MeshData mesh;
+	MappedFile entry;
+	std::vector<float> vertices;
+	std::vector<unsigned short> indices16;
+	bool from_cache = false;
+	double import_ms = 0.0;
+};
+
 class Model
 {
 public:
@@ -40,10 +56,8 @@ public:
 	Model() {}
 
 	Model(const std::string& str_path, bool use_normal = true, bool use_uv = true, bool use_tangent = false)
-		: _use_normal(use_normal), _use_uv(use_uv), _use_tangent(use_tangent)
 	{
-		_LoadMeshFromFile(str_path);
-		_BindBuffer();
+		init(str_path, use_normal, use_uv, use_tangent);
 	}
 
 	~Model()
@@ -52,140 +66,119 @@ public:
 	}
 
 	void init(const std::string& str_path, bool use_normal = true, bool use_uv = true, bool use_tangent = false, bool use_bitangent = false)
+	{
+		MeshImport import;
+		prepare(str_path, import, use_normal, use_uv, use_tangent, use_bitangent);
+		upload(import);
+	}
+
+	// init() in two halves, so a loader can import on worker threads. prepare()
+	// reads the mesh cache or runs the Assimp import and makes no GL calls;
+	// it returns false if the file could not be loaded. upload() creates the
+	// buffers and must run on the GL thread. In between, the model must not be
+	// used by other threads.
+	bool prepare(const std::string& str_path, MeshImport& import, bool use_normal = true, bool use_uv = true, bool use_tangent = false, bool use_bitangent = false)
 	{
 		_use_normal = use_normal;
 		_use_uv = use_uv;
 		_use_tangent = use_tangent;
 		_use_bitangent = use_bitangent;
-		_LoadMeshFromFile(str_path);
-		_BindBuffer();
+		return _Prepare(str_path, import);
 	}
 
-	void destory()
+	void upload(const MeshImport& import)
 	{
-		glDeleteBuffers(1, &elementBuffer);
-		glDeleteBuffers(1, &vertexBuffer);
-		if (_use_normal)
-			glDeleteBuffers(1, &normalBuffer);
-		if (_use_uv)
-			glDeleteBuffers(1, &uvBuffer);
-		if (_use_tangent)
-			glDeleteBuffers(1, &tangent_buffer);
-		if (_use_bitangent)
-			glDeleteBuffers(1, &bitangent_buffer);
+		destory();
+		if (import.mesh.vertices != NULL)
+			_Upload(import.mesh);
 	}
 
-	void render()
+	// Reorder the next imports for the vertex cache, overdraw and vertex
+	// fetch; see MeshOptimizer.h. Off by default, since it rewrites the order
+	// of Triangles() and Vertices().
+	void set_optimize(bool optimize)
 	{
-		GLuint attribute_index = 0;
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(attribute_index);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-		glVertexAttribPointer(
-			attribute_index,                  // attribute
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		attribute_index++;
-
-		// 2nd attribute buffer : UVs
-		if (_use_normal)
-		{
-			glEnableVertexAttribArray(attribute_index);
-			glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-			glVertexAttribPointer(
-				attribute_index,                  // attribute
-				3,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-
-			attribute_index++;
-		}
-
-		if (_use_tangent)
-		{
-			glEnableVertexAttribArray(attribute_index);
-			glBindBuffer(GL_ARRAY_BUFFER, tangent_buffer);
-			glVertexAttribPointer(
-				attribute_index,                  // attribute
-				3,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-
-			attribute_index++;
-		}
-
-		if (_use_uv)
-		{
-			// 3rd attribute buffer : UVs
-			glEnableVertexAttribArray(attribute_index);
-			glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-			glVertexAttribPointer(
-				attribute_index,                  // attribute
-				2,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-			attribute_index++;
-		}
-
-		if (_use_bitangent)
-		{
-			glEnableVertexAttribArray(attribute_index);
-			glBindBuffer(GL_ARRAY_BUFFER, bitangent_buffer);
-			glVertexAttribPointer(
-				attribute_index,                  // attribute
-				3,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-
-			attribute_index++;
-		}
+		_optimize = optimize;
+	}
 
+	// True once the buffers exist; render() draws nothing before that.
+	bool ready() const
+	{
+		return vertexArray != 0;
+	}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	void destory()
+	{
+		if (vertexArray != 0)
+			glDeleteVertexArrays(1, &vertexArray);
+		if (vertexBuffer != 0)
+			glDeleteBuffers(1, &vertexBuffer);
+		if (elementBuffer != 0)
+			glDeleteBuffers(1, &elementBuffer);
+		vertexArray = vertexBuffer = elementBuffer = 0;
+		_vertex_count = _index_count = 0;
+	}
 
-		// Draw the triangle !
-		//glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+	// The vertex array holds the whole layout, so drawing is a bind and a draw.
+	void render()
+	{
+		if (vertexArray == 0)
+			return;
+		glBindVertexArray(vertexArray);
 		glDrawElements(
 			GL_TRIANGLES,
-			(GLsizei)_triangles.size(),
-			GL_UNSIGNED_INT,
+			(GLsizei)_index_count,
+			_index_type,
 			(void*)0
 		);
+	}
+
+	// Describe the interleaved layout of _Interleave() on binding point 0 of
+	// vertex_array; returns the number of attributes enabled. Shared with
+	// MeshArena, whose buffers hold the same layout.
+	static GLuint set_vertex_format(GLuint vertex_array, bool use_normal, bool use_uv, bool use_tangent, bool use_bitangent)
+	{
+		const bool enabled[] = { true, use_normal, use_tangent, use_uv, use_bitangent };
+		const GLint sizes[] = { 3, 3, 3, 2, 3 };
+		GLuint attribute_index = 0;
+		GLuint offset = 0;
+		for (int a = 0; a < 5; a++) {
+			if (!enabled[a])
+				continue;
+			glEnableVertexArrayAttrib(vertex_array, attribute_index);
+			glVertexArrayAttribFormat(vertex_array, attribute_index, sizes[a], GL_FLOAT, GL_FALSE, offset * sizeof(float));
+			glVertexArrayAttribBinding(vertex_array, attribute_index, 0);
+			attribute_index++;
+			offset += sizes[a];
+		}
+		return attribute_index;
+	}
 
-		glDisableVertexAttribArray(0);
-		if (_use_normal)
-			glDisableVertexAttribArray(1);
-		if (_use_uv)
-			glDisableVertexAttribArray(2);
+	// Bytes between consecutive vertices of vertexBuffer.
+	GLsizei Stride() const
+	{
+		return _stride;
 	}
 
 	unsigned int VertexCount() const
 	{
-		return (unsigned int)_vertices.size();
+		return _vertex_count;
 	}
 
 	unsigned int IndexCount() const
 	{
-		return (unsigned int)_triangles.size();
+		return _index_count;
+	}
+
+	// GL_UNSIGNED_SHORT whenever the vertex count allows it.
+	GLenum IndexType() const
+	{
+		return _index_type;
 	}
 
+	// The arrays below are only filled when the mesh was imported; a load from
+	// the mesh cache goes straight from the mapped file to the GPU.
+
 	const UIntArray& Triangles() const
 	{
 		return _triangles;
@@ -207,22 +200,72 @@ public:
 	}
 
 private:
-void _LoadMeshFromFile(const std::string& str_path){
+	// Imports through Assimp unless MeshCache has this file with the same
+	// layout; a fresh import is stored for the next run.
+	bool _Prepare(const std::string& str_path, MeshImport& import)
+	{
 		_triangles.clear();
 		_vertices.clear();
 		_normals.clear();
 		_uv.clear();
-		_triangles.clear();
+		_tangent.clear();
 		_bitangent.clear();
+		_stride = _LayoutStride();
 
-		if (_access(str_path.c_str(), 0) == -1)
-		{
-			cout << "Model file " + str_path + " not exists!" << endl;
-			return;
+		MeshCache& cache = MeshCache::instance();
+		hash64_t key = cache.key(str_path, _LayoutFlags(), _ImportFlags());
+		import.mesh = MeshData();
+		import.from_cache = cache.load(key, _stride, import.entry, import.mesh);
+		if (import.from_cache)
+			return true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		_LoadMeshFromFile(str_path);
+		if (_vertices.empty() || _triangles.empty())
+			return false;
+		if (_optimize)
+			_Optimize();
+		_Interleave(import.vertices);
+		MeshData& mesh = import.mesh;
+		mesh.vertices = &import.vertices[0];
+		mesh.indices = &_triangles[0];
+		mesh.vertex_count = (unsigned int)_vertices.size();
+		mesh.index_count = (unsigned int)_triangles.size();
+		mesh.stride = _stride;
+		if (_vertices.size() <= 65536){
+			import.indices16.assign(_triangles.begin(), _triangles.end());
+			mesh.indices = &import.indices16[0];
+			mesh.index_size = 2;
 		}
+		import.import_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		cache.store(key, mesh, import.import_ms);
+		return true;
+	}
 
-		Assimp::Importer importer;
-		const char* path = str_path.c_str();
+	unsigned int _LayoutFlags() const
+	{
+		return (_use_normal ? 1 : 0) | (_use_uv ? 2 : 0) | (_use_tangent ? 4 : 0) | (_use_bitangent ? 8 : 0) |
+			(_optimize ? 16 : 0);
+	}
+
+	// Vertex cache order, then overdraw order, then vertices renumbered by
+	// first use; every vertex stream follows the renumbering.
+	void _Optimize()
+	{
+		unsigned int* indices = &_triangles[0];
+		optimize_vertex_cache(indices, indices, _triangles.size(), _vertices.size());
+		optimize_overdraw(indices, indices, _triangles.size(), &_vertices[0].x, _vertices.size(), 3);
+		std::vector<unsigned int> remap;
+		size_t used = optimize_vertex_fetch(remap, indices, _triangles.size(), _vertices.size());
+		remap_vertices(_vertices, remap, used);
+		remap_vertices(_normals, remap, used);
+		remap_vertices(_uv, remap, used);
+		remap_vertices(_tangent, remap, used);
+		remap_vertices(_bitangent, remap, used);
+	}
+
+	unsigned int _ImportFlags() const
+	{
 		unsigned int load_option =
 			//aiProcess_CalcTangentSpace |
 			aiProcess_Triangulate |
@@ -230,7 +273,25 @@ void _LoadMeshFromFile(const std::string& str_path){
 			aiProcess_SortByPType;
 		if (_use_normal) load_option |= aiProcess_GenSmoothNormals;
 		if (_use_tangent || _use_bitangent) load_option |= aiProcess_CalcTangentSpace;
-		const aiScene* scene = importer.ReadFile(path, load_option);
+		return load_option;
+	}
+
+	GLsizei _LayoutStride() const
+	{
+		GLint floats = 3 + (_use_normal ? 3 : 0) + (_use_tangent ? 3 : 0) + (_use_uv ? 2 : 0) + (_use_bitangent ? 3 : 0);
+		return floats * (GLsizei)sizeof(float);
+	}
+
+void _LoadMeshFromFile(const std::string& str_path){
+		if (!file_exists(str_path))
+		{
+			cout << "Model file " + str_path + " not exists!" << endl;
+			return;
+		}
+
+		Assimp::Importer importer;
+		const char* path = str_path.c_str();
+		const aiScene* scene = importer.ReadFile(path, _ImportFlags());
 
 		if (!scene) {
 			cout << "Can not open model " + str_path + ". Maybe this file type is not supported by assimp loader" << endl;
@@ -302,59 +363,58 @@ void _LoadMeshFromFile(const std::string& str_path){
 		}
 	}
 
-void _BindBuffer()
+// Vertex layout: position, then normal, tangent, uv and bitangent when
+// enabled, interleaved in one buffer. Attribute locations are numbered in
+// that order, skipping the disabled ones.
+void _Interleave(std::vector<float>& interleaved) const
 	{
-
-		GLuint VertexArrayID;
-		glGenVertexArrays(1, &VertexArrayID);
-		glBindVertexArray(VertexArrayID);
-
-		glGenBuffers(1, &elementBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _triangles.size() * sizeof(unsigned int), &_triangles[0], GL_STATIC_DRAW);
-
-		// Load it into a VBO
-		glGenBuffers(1, &vertexBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-		glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(glm::vec3), &_vertices[0], GL_STATIC_DRAW);
-
-		if (_use_normal)
-		{
-			glGenBuffers(1, &normalBuffer);
-			glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-			glBufferData(GL_ARRAY_BUFFER, _normals.size() * sizeof(glm::vec3), &_normals[0], GL_STATIC_DRAW);
-		}
-
-		if (_use_tangent)
-		{
-			glGenBuffers(1, &tangent_buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, tangent_buffer);
-			glBufferData(GL_ARRAY_BUFFER, _tangent.size() * sizeof(glm::vec3), &_tangent[0], GL_STATIC_DRAW);
-		}
-
-		if (_use_uv)
-		{
-			glGenBuffers(1, &uvBuffer);
-			glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-			glBufferData(GL_ARRAY_BUFFER, _uv.size() * sizeof(glm::vec2), &_uv[0], GL_STATIC_DRAW);
-		}
-
-		if (_use_bitangent)
-		{
-			glGenBuffers(1, &bitangent_buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, bitangent_buffer);
-			glBufferData(GL_ARRAY_BUFFER, _bitangent.size() * sizeof(glm::vec3), &_bitangent[0], GL_STATIC_DRAW);
+		interleaved.clear();
+		if (_vertices.empty())
+			return;
+		struct Attribute { bool enabled; GLint size; const float* data; };
+		Attribute attributes[] = {
+			{ true, 3, &_vertices[0].x },
+			{ _use_normal, 3, _normals.empty() ? NULL : &_normals[0].x },
+			{ _use_tangent, 3, _tangent.empty() ? NULL : &_tangent[0].x },
+			{ _use_uv, 2, _uv.empty() ? NULL : &_uv[0].x },
+			{ _use_bitangent, 3, _bitangent.empty() ? NULL : &_bitangent[0].x },
+		};
+		const int attribute_count = sizeof(attributes) / sizeof(attributes[0]);
+		GLint floats = _stride / (GLint)sizeof(float);
+		interleaved.resize(_vertices.size() * floats);
+		GLint offset = 0;
+		for (int a = 0; a < attribute_count; a++) {
+			if (!attributes[a].enabled)
+				continue;
+			for (size_t v = 0; v < _vertices.size(); v++)
+				for (GLint c = 0; c < attributes[a].size; c++)
+					interleaved[v * floats + offset + c] = attributes[a].data[v * attributes[a].size + c];
+			offset += attributes[a].size;
 		}
+	}
 
+// One immutable vertex buffer and index buffer, described once by a vertex
+// array. mesh may point into a mapped cache entry.
+void _Upload(const MeshData& mesh)
+	{
+		_vertex_count = mesh.vertex_count;
+		_index_count = mesh.index_count;
+		_index_type = mesh.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		glCreateBuffers(1, &vertexBuffer);
+		glNamedBufferStorage(vertexBuffer, (GLsizeiptr)mesh.vertex_count * mesh.stride, mesh.vertices, 0);
+		glCreateBuffers(1, &elementBuffer);
+		glNamedBufferStorage(elementBuffer, (GLsizeiptr)mesh.index_count * mesh.index_size, mesh.indices, 0);
+
+		glCreateVertexArrays(1, &vertexArray);
+		glVertexArrayVertexBuffer(vertexArray, 0, vertexBuffer, 0, _stride);
+		glVertexArrayElementBuffer(vertexArray, elementBuffer);
+		set_vertex_format(vertexArray, _use_normal, _use_uv, _use_tangent, _use_bitangent);
 	}
 
 public:
-	GLuint elementBuffer;
-	GLuint vertexBuffer;
-	GLuint normalBuffer;
-	GLuint tangent_buffer;
-	GLuint bitangent_buffer;
-	GLuint uvBuffer;
+	GLuint vertexArray = 0;
+	GLuint vertexBuffer = 0;
+	GLuint elementBuffer = 0;
 
 private:
 	std::vector<unsigned int> _triangles;
@@ -368,5 +428,10 @@ private:
 	bool _use_uv = true;
 	bool _use_tangent = false;
 	bool _use_bitangent = false;
+	GLsizei _stride = 0;
+	unsigned int _vertex_count = 0;
+	unsigned int _index_count = 0;
+	GLenum _index_type = GL_UNSIGNED_INT;
+	bool _optimize = false;
 };
 #endif
\ No newline at end of file
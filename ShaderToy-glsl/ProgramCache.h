@@ -0,0 +1,220 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glew.h>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include "Hash.h"
+#include "FileUtil.h"
+
+struct ProgramCacheStats
+{
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	unsigned int stores = 0;
+	unsigned int rejected = 0;		// entries the driver refused to load
+	double compile_ms_saved = 0.0;
+};
+
+// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+// Entries are keyed by the preprocessed sources plus the GL vendor, renderer
+// and version strings, so a driver update or a different GPU simply misses.
+// Entries are written to a temporary file and renamed into place, which lets
+// several processes share one cache directory.
+class ProgramCache
+{
+public:
+	static ProgramCache& instance()
+	{
+		static ProgramCache cache;
+		return cache;
+	}
+
+	void set_directory(const std::string& dir)
+	{
+		_dir = dir;
+		_dir_created = false;
+	}
+
+	void set_enabled(bool enabled)
+	{
+		_enabled = enabled;
+	}
+
+	// Program binaries need at least one binary format from the driver.
+	bool enabled()
+	{
+		if (!_enabled)
+			return false;
+		if (_formats < 0){
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &_formats);
+			if (_formats <= 0)
+				printf("Program binary cache disabled: driver reports no binary formats\n");
+		}
+		return _formats > 0;
+	}
+
+	hash64_t key(const std::string& vertex_code, const std::string& fragment_code)
+	{
+		hash64_t h = _DriverHash();
+		h = hash_fnv1a(vertex_code, h);
+		h = hash_fnv1a(fragment_code, h);
+		return h;
+	}
+
+	// Creates a program from the cached binary for key. Returns 0 on a miss or
+	// when the driver rejects the binary; the caller then compiles from source.
+	GLuint load(hash64_t key)
+	{
+		if (!enabled())
+			return 0;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		FILE* fp = fopen(_EntryPath(key).c_str(), "rb");
+		if (fp == NULL){
+			_stats.misses++;
+			return 0;
+		}
+		EntryHeader header;
+		std::vector<char> binary;
+		bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+			header.magic == ENTRY_MAGIC && header.version == ENTRY_VERSION && header.key == key;
+		if (ok){
+			binary.resize(header.length);
+			ok = header.length > 0 && fread(&binary[0], 1, header.length, fp) == header.length;
+		}
+		fclose(fp);
+		if (!ok){
+			_stats.misses++;
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, header.format, &binary[0], (GLsizei)binary.size());
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked != GL_TRUE){
+			glDeleteProgram(program);
+			_stats.rejected++;
+			_stats.misses++;
+			return 0;
+		}
+
+		double load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		_stats.hits++;
+		if (header.compile_ms > load_ms)
+			_stats.compile_ms_saved += header.compile_ms - load_ms;
+		return program;
+	}
+
+	// Writes the binary of a freshly linked program. compile_ms is the source
+	// compile + link time it took, recorded so later hits can report savings.
+	void store(hash64_t key, GLuint program, double compile_ms)
+	{
+		if (!enabled() || !_EnsureDirectory())
+			return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		std::vector<char> binary(length);
+		EntryHeader header;
+		header.magic = ENTRY_MAGIC;
+		header.version = ENTRY_VERSION;
+		header.key = key;
+		header.compile_ms = compile_ms;
+		GLsizei written = 0;
+		glGetProgramBinary(program, length, &written, &header.format, &binary[0]);
+		if (written <= 0)
+			return;
+		header.length = (unsigned int)written;
+
+		static std::atomic<unsigned int> counter(0);
+		char suffix[64];
+		sprintf(suffix, ".%d.%u.tmp", process_id(), counter++);
+		std::string path = _EntryPath(key);
+		std::string tmp_path = path + suffix;
+		FILE* fp = fopen(tmp_path.c_str(), "wb");
+		if (fp == NULL)
+			return;
+		bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			fwrite(&binary[0], 1, written, fp) == (size_t)written;
+		ok = fclose(fp) == 0 && ok;
+		if (!ok || !replace_file(tmp_path, path)){
+			remove(tmp_path.c_str());
+			return;
+		}
+		_stats.stores++;
+	}
+
+	const ProgramCacheStats& stats() const
+	{
+		return _stats;
+	}
+
+	void print_stats() const
+	{
+		printf("program cache: %u hits, %u misses, %u stored, %u rejected, %.1f ms compile time saved\n",
+			_stats.hits, _stats.misses, _stats.stores, _stats.rejected, _stats.compile_ms_saved);
+	}
+
+private:
+	enum { ENTRY_MAGIC = 0x42505453 /* "STPB" */, ENTRY_VERSION = 1 };
+
+	struct EntryHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		hash64_t key;
+		GLenum format;
+		unsigned int length;
+		double compile_ms;
+	};
+
+	ProgramCache() {}
+
+	hash64_t _DriverHash()
+	{
+		if (_driver_hash == 0){
+			const char* strings[3] = {
+				(const char*)glGetString(GL_VENDOR),
+				(const char*)glGetString(GL_RENDERER),
+				(const char*)glGetString(GL_VERSION)
+			};
+			hash64_t h = FNV1A_64_INIT;
+			for (int i = 0; i < 3; i++)
+				h = hash_fnv1a(std::string(strings[i] ? strings[i] : ""), h);
+			_driver_hash = h;
+		}
+		return _driver_hash;
+	}
+
+	std::string _EntryPath(hash64_t key) const
+	{
+		return _dir + "/" + hash_to_string(key) + ".bin";
+	}
+
+	bool _EnsureDirectory()
+	{
+		if (_dir_created)
+			return true;
+		_dir_created = make_directory(_dir);
+		if (!_dir_created)
+			printf("Can not create program cache directory %s\n", _dir.c_str());
+		return _dir_created;
+	}
+
+	std::string _dir = "shader_cache";
+	bool _dir_created = false;
+	bool _enabled = true;
+	GLint _formats = -1;
+	hash64_t _driver_hash = 0;
+	ProgramCacheStats _stats;
+};
+
+#endif
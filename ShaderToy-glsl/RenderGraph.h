@@ -0,0 +1,599 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include "Shader.h"
+#include "FullscreenTriangle.h"
+#include "GpuTimer.h"
+#include "TextureCache.h"
+
+// ShaderToy's passes. Buffers render into offscreen textures, Image renders
+// to the default framebuffer.
+enum PassId
+{
+	PASS_BUFFER_A,
+	PASS_BUFFER_B,
+	PASS_BUFFER_C,
+	PASS_BUFFER_D,
+	PASS_IMAGE,
+	PASS_COUNT
+};
+
+static const char* const PASS_NAMES[PASS_COUNT] = { "bufA", "bufB", "bufC", "bufD", "image" };
+
+inline int pass_from_name(const std::string& name)
+{
+	for (int i = 0; i < PASS_COUNT; i++)
+		if (name == PASS_NAMES[i])
+			return i;
+	return -1;
+}
+
+// What one iChannel of a pass samples.
+struct ChannelInput
+{
+	enum Type { NONE, PASS, TEXTURE };
+
+	Type type;
+	int pass;				// PASS: source pass
+	bool previous_frame;	// PASS: read the source's output of the previous frame
+	GLuint texture;			// TEXTURE: texture object
+	bool cached;			// TEXTURE: held from TextureCache, else owned by the caller
+	glm::vec3 resolution;	// TEXTURE: size reported in iChannelResolution
+
+	ChannelInput() : type(NONE), pass(-1), previous_frame(false), texture(0), cached(false), resolution(0.0f) {}
+};
+
+struct RenderPass
+{
+	Shader shader;
+	std::string frag_path;
+	bool defined = false;
+	bool needs_build = false;		// shader not compiled from frag_path yet
+	bool active = false;			// consumed (directly or not) by the Image pass
+	bool double_buffered = false;	// some consumer reads the previous frame
+	ChannelInput channels[4];
+	GLuint framebuffers[2];
+	GLuint textures[2];
+	int write_index = 0;
+	bool program_dirty = true;		// per-program uniforms must be (re)set
+	Uniform<Sampler> u_channels[4];
+	Uniform<glm::vec3> u_channel_resolution;
+	Uniform<glm::vec2> u_tile_offset;
+	Uniform<glm::vec2> u_interleave;
+
+	RenderPass()
+	{
+		framebuffers[0] = framebuffers[1] = 0;
+		textures[0] = textures[1] = 0;
+	}
+};
+
+// ShaderToy-style multipass renderer: Buffer A-D plus Image, each reading up
+// to four iChannels. build() orders the passes topologically on their
+// same-frame dependencies, culls passes the Image pass never consumes and
+// allocates a second (ping-pong) target only for passes that are read as
+// previous-frame feedback.
+class RenderGraph
+{
+public:
+	RenderGraph() {}
+
+	~RenderGraph()
+	{
+		_ReleaseTargets();
+		for (int p = 0; p < PASS_COUNT; p++)
+			for (int c = 0; c < 4; c++)
+				_ReleaseChannel(_passes[p].channels[c]);
+	}
+
+	void set_vertex_shader(const std::string& path)
+	{
+		_vert_path = path;
+		for (int p = 0; p < PASS_COUNT; p++)
+			_passes[p].needs_build = _passes[p].defined;
+	}
+
+	// Build the passes so gl_FragCoord reads the virtual canvas of
+	// set_tile_offset() and set_interleave(). Off by default: plain rendering
+	// compiles the shaders untouched. Passes already built are rebuilt.
+	void set_frag_coord_remap(bool remap)
+	{
+		if (remap == _frag_coord_remap)
+			return;
+		_frag_coord_remap = remap;
+		for (size_t i = 0; i < _order.size(); i++){
+			RenderPass& pass = _passes[_order[i]];
+			if (pass.needs_build)
+				continue;
+			pass.shader.init_async(_vert_path.c_str(), pass.frag_path.c_str(), true, _frag_coord_remap);
+			pass.program_dirty = true;
+		}
+	}
+
+	// The shader is compiled by build(), and only if the pass is not culled.
+	void set_pass(int pass, const std::string& frag_path)
+	{
+		_passes[pass].frag_path = frag_path;
+		_passes[pass].defined = true;
+		_passes[pass].needs_build = true;
+		_passes[pass].program_dirty = true;
+	}
+
+	// channel of pass reads the output of source. A pass reading itself
+	// always gets its previous frame.
+	void set_channel(int pass, int channel, int source, bool previous_frame = false)
+	{
+		ChannelInput& in = _passes[pass].channels[channel];
+		_ReleaseChannel(in);
+		in.type = ChannelInput::PASS;
+		in.pass = source;
+		in.previous_frame = previous_frame || source == pass;
+		_passes[pass].program_dirty = true;
+	}
+
+	void set_channel_texture(int pass, int channel, GLuint texture, glm::vec3 resolution)
+	{
+		ChannelInput& in = _passes[pass].channels[channel];
+		_ReleaseChannel(in);
+		in.type = ChannelInput::TEXTURE;
+		in.texture = texture;
+		in.resolution = resolution;
+		_passes[pass].program_dirty = true;
+	}
+
+	// channel of pass samples the image file at path, shared through
+	// TextureCache with every other channel showing the same image.
+	bool set_channel_file(int pass, int channel, const std::string& path, const TextureSettings& settings)
+	{
+		glm::vec3 resolution;
+		GLuint texture = TextureCache::instance().acquire(path, settings, &resolution);
+		if (texture == 0)
+			return false;
+		set_channel_texture(pass, channel, texture, resolution);
+		_passes[pass].channels[channel].cached = true;
+		return true;
+	}
+
+	// Set a channel from its .graph token: a pass name with an optional
+	// ":prev" suffix, or an image file (relative to dir unless dir is empty)
+	// followed by TextureSettings options, e.g. "noise.png:nearest:clamp".
+	bool set_channel_token(int pass, int channel, const std::string& token, const std::string& dir)
+	{
+		std::string name = token;
+		std::vector<std::string> options;
+		size_t colon;
+		while ((colon = name.rfind(':')) != std::string::npos){
+			options.insert(options.begin(), name.substr(colon + 1));
+			name = name.substr(0, colon);
+		}
+		int source = pass_from_name(name);
+		if (source < 0 && name.find('.') != std::string::npos){
+			TextureSettings settings;
+			for (size_t o = 0; o < options.size(); o++){
+				if (!settings.parse(options[o])){
+					printf("unknown texture option '%s'\n", options[o].c_str());
+					return false;
+				}
+			}
+			return set_channel_file(pass, channel, dir.empty() ? name : dir + "/" + name, settings);
+		}
+		if (source < 0 || source == PASS_IMAGE || options.size() > 1 || (options.size() == 1 && options[0] != "prev")){
+			printf("unknown channel input '%s'\n", token.c_str());
+			return false;
+		}
+		set_channel(pass, channel, source, !options.empty());
+		return true;
+	}
+
+	// Load a graph description. One pass per line, channels are "none", a
+	// token as for set_channel_token(). A "vertex" line replaces the vertex
+	// shader of every pass. Shader and image paths are relative to the
+	// description file:
+	//     bufA  sim_frag.glsl   bufA:prev  noise.png
+	//     image show_frag.glsl  bufA
+	bool load(const std::string& path)
+	{
+		std::ifstream stream(path.c_str(), std::ios::in);
+		if (!stream.is_open()){
+			printf("Impossible to open render graph %s\n", path.c_str());
+			return false;
+		}
+		std::string dir = directory_of(path);
+		std::string line;
+		int line_number = 0;
+		while (getline(stream, line)){
+			line_number++;
+			std::istringstream tokens(line);
+			std::string pass_name, frag;
+			if (!(tokens >> pass_name) || pass_name[0] == '#')
+				continue;
+			if (pass_name == "vertex" && tokens >> frag){
+				set_vertex_shader(dir + "/" + frag);
+				continue;
+			}
+			int pass = pass_from_name(pass_name);
+			if (pass < 0 || !(tokens >> frag)){
+				printf("%s:%d: expected '<pass> <fragment shader> [channels]'\n", path.c_str(), line_number);
+				return false;
+			}
+			set_pass(pass, dir + "/" + frag);
+			std::string channel;
+			for (int c = 0; c < 4 && tokens >> channel; c++){
+				if (channel == "none")
+					continue;
+				if (!set_channel_token(pass, c, channel, dir)){
+					printf("%s:%d: in iChannel%d of %s\n", path.c_str(), line_number, c, PASS_NAMES[pass]);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Resolve execution order, cull unused passes, start compiling the
+	// shaders of the passes that are kept and (re)allocate targets. Call
+	// after configuring passes and channels.
+	bool build(int width, int height)
+	{
+		_width = width;
+		_height = height;
+		_order.clear();
+		if (!_passes[PASS_IMAGE].defined){
+			printf("Render graph has no image pass\n");
+			return false;
+		}
+
+		for (int p = 0; p < PASS_COUNT; p++){
+			_passes[p].active = false;
+			_passes[p].double_buffered = false;
+			_passes[p].program_dirty = true;
+			for (int c = 0; c < 4; c++){
+				ChannelInput& in = _passes[p].channels[c];
+				if (in.type == ChannelInput::PASS && !_passes[in.pass].defined){
+					printf("%s reads undefined pass %s, ignored\n", PASS_NAMES[p], PASS_NAMES[in.pass]);
+					in = ChannelInput();
+				}
+			}
+		}
+
+		// Cull: everything reachable backwards from Image, through both
+		// same-frame and feedback reads, is kept.
+		std::vector<int> stack(1, (int)PASS_IMAGE);
+		_passes[PASS_IMAGE].active = true;
+		while (!stack.empty()){
+			int p = stack.back();
+			stack.pop_back();
+			for (int c = 0; c < 4; c++){
+				const ChannelInput& in = _passes[p].channels[c];
+				if (in.type != ChannelInput::PASS)
+					continue;
+				if (in.previous_frame)
+					_passes[in.pass].double_buffered = true;
+				if (!_passes[in.pass].active){
+					_passes[in.pass].active = true;
+					stack.push_back(in.pass);
+				}
+			}
+		}
+
+		// Order: Kahn's algorithm on same-frame reads, lowest pass first so
+		// the result is stable (A, B, C, D, Image when unconstrained).
+		int pending[PASS_COUNT] = {};
+		for (int p = 0; p < PASS_COUNT; p++){
+			if (!_passes[p].active) continue;
+			for (int c = 0; c < 4; c++){
+				const ChannelInput& in = _passes[p].channels[c];
+				if (in.type == ChannelInput::PASS && !in.previous_frame)
+					pending[p]++;
+			}
+		}
+		bool scheduled[PASS_COUNT] = {};
+		for (;;){
+			int next = -1;
+			for (int p = 0; p < PASS_COUNT && next < 0; p++)
+				if (_passes[p].active && !scheduled[p] && pending[p] == 0)
+					next = p;
+			if (next < 0)
+				break;
+			scheduled[next] = true;
+			_order.push_back(next);
+			for (int p = 0; p < PASS_COUNT; p++){
+				if (!_passes[p].active) continue;
+				for (int c = 0; c < 4; c++){
+					const ChannelInput& in = _passes[p].channels[c];
+					if (in.type == ChannelInput::PASS && !in.previous_frame && in.pass == next)
+						pending[p]--;
+				}
+			}
+		}
+		for (int p = 0; p < PASS_COUNT; p++){
+			if (_passes[p].active && !scheduled[p]){
+				printf("Render graph has a same-frame cycle through %s; read one of the inputs with :prev\n", PASS_NAMES[p]);
+				_order.clear();
+				return false;
+			}
+		}
+
+		// builds started back to back compile concurrently
+		for (size_t i = 0; i < _order.size(); i++){
+			RenderPass& pass = _passes[_order[i]];
+			if (!pass.needs_build)
+				continue;
+			pass.shader.init_async(_vert_path.c_str(), pass.frag_path.c_str(), true, _frag_coord_remap);
+			pass.needs_build = false;
+		}
+
+		_AllocateTargets();
+		return true;
+	}
+
+	void resize(int width, int height)
+	{
+		if (width == _width && height == _height)
+			return;
+		_width = width;
+		_height = height;
+		_AllocateTargets();
+		for (int p = 0; p < PASS_COUNT; p++)
+			_passes[p].program_dirty = true;
+	}
+
+	// Framebuffer the Image pass draws into; 0 is the window.
+	void set_output(GLuint framebuffer)
+	{
+		_passes[PASS_IMAGE].framebuffers[0] = framebuffer;
+	}
+
+	// Clear every buffer pass back to black, so feedback restarts as on the
+	// first frame.
+	void clear_feedback()
+	{
+		for (int p = 0; p < PASS_IMAGE; p++)
+			for (int i = 0; i < 2; i++)
+				if (_passes[p].textures[i])
+					glClearTexImage(_passes[p].textures[i], 0, GL_RGBA, GL_FLOAT, &glm::vec4(0.0f)[0]);
+	}
+
+	// Block until every active pass has finished building. Returns false if
+	// some pass has no usable program.
+	bool wait_ready()
+	{
+		bool ok = true;
+		for (size_t i = 0; i < _order.size(); i++){
+			RenderPass& pass = _passes[_order[i]];
+			if (pass.shader.finish())
+				pass.program_dirty = true;
+			ok = ok && pass.shader.ready();
+		}
+		return ok;
+	}
+
+	// True once every active pass has a program; never blocks.
+	bool ready() const
+	{
+		for (size_t i = 0; i < _order.size(); i++)
+			if (!_passes[_order[i]].shader.ready())
+				return false;
+		return true;
+	}
+
+	// True if some pass reads a previous frame, i.e. a frame's image depends
+	// on every frame rendered before it.
+	bool has_feedback() const
+	{
+		for (int p = 0; p < PASS_COUNT; p++)
+			if (_passes[p].active && _passes[p].double_buffered)
+				return true;
+		return false;
+	}
+
+	// Pixel offset of the rendered area inside a larger virtual canvas; with
+	// set_frag_coord_remap(true) every pass sees gl_FragCoord shifted by it.
+	// Used by the tiled still renderer, where iResolution is the full canvas
+	// and the graph is built at tile size.
+	void set_tile_offset(glm::vec2 offset)
+	{
+		_tile_offset = offset;
+		for (int p = 0; p < PASS_COUNT; p++)
+			_passes[p].program_dirty = true;
+	}
+
+	// Interleaved rendering: the graph is built 1/n as wide as the canvas and
+	// each fragment shades every nth pixel of its row, starting at column
+	// (row + phase) % n, given set_frag_coord_remap(true). n = 1 turns it
+	// off. Changes every frame, so it is set at draw time rather than with
+	// the per-program state.
+	void set_interleave(int n, int phase)
+	{
+		_interleave = glm::vec2((float)n, (float)phase);
+	}
+
+	// Draw every active pass in order. The ShaderToyInputs block must already
+	// be bound for this frame. Passes whose program is still building keep
+	// their previous output.
+	void render(FullscreenTriangle& quad)
+	{
+		for (size_t i = 0; i < _order.size(); i++){
+			RenderPass& pass = _passes[_order[i]];
+			if (pass.shader.poll())
+				pass.program_dirty = true;
+			if (pass.double_buffered && pass.shader.ready())
+				pass.write_index = 1 - pass.write_index;
+			// streamed images only know their size once decoded
+			for (int c = 0; c < 4; c++){
+				ChannelInput& in = pass.channels[c];
+				if (in.type == ChannelInput::TEXTURE && in.cached && in.resolution.x == 0.0f &&
+					TextureCache::instance().resolution(in.texture, in.resolution))
+					pass.program_dirty = true;
+			}
+		}
+
+		for (size_t i = 0; i < _order.size(); i++){
+			int id = _order[i];
+			RenderPass& pass = _passes[id];
+			if (!pass.shader.ready())
+				continue;
+			if (_timer)
+				_timer->begin(_timer_scopes[id]);
+			glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffers[pass.write_index]);
+			glViewport(0, 0, _width, _height);
+			pass.shader.use();
+			if (pass.program_dirty)
+				_ApplyProgramState(pass);
+			pass.shader.set(pass.u_interleave, _interleave);
+			// unconnected channels bind 0, so they sample black rather than
+			// whatever an earlier pass left on the unit
+			for (int c = 0; c < 4; c++){
+				glActiveTexture(GL_TEXTURE0 + c);
+				glBindTexture(GL_TEXTURE_2D, _ChannelTexture(pass.channels[c]));
+			}
+			quad.render();
+			if (_timer)
+				_timer->end(_timer_scopes[id]);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// Time every pass on the GPU under its PASS_NAMES scope. The caller owns
+	// the timer and brackets each frame with begin_frame()/end_frame().
+	void set_timer(GpuTimer* timer)
+	{
+		_timer = timer;
+		if (_timer)
+			for (int p = 0; p < PASS_COUNT; p++)
+				_timer_scopes[p] = _timer->scope(PASS_NAMES[p]);
+	}
+
+	// Execution order of the active passes, valid after build().
+	const std::vector<int>& order() const
+	{
+		return _order;
+	}
+
+	// Every pass shader that build() compiled, for hot-reload.
+	std::vector<Shader*> shaders()
+	{
+		std::vector<Shader*> result;
+		for (int p = 0; p < PASS_COUNT; p++)
+			if (_passes[p].defined && !_passes[p].needs_build)
+				result.push_back(&_passes[p].shader);
+		return result;
+	}
+
+	// Output texture of a buffer pass for the current frame.
+	GLuint output(int pass) const
+	{
+		return _passes[pass].textures[_passes[pass].write_index];
+	}
+
+private:
+	GLuint _ChannelTexture(const ChannelInput& in) const
+	{
+		// a streamed texture does not exist until it is decoded
+		if (in.type == ChannelInput::TEXTURE)
+			return in.cached && in.resolution.x == 0.0f ? 0 : in.texture;
+		if (in.type != ChannelInput::PASS)
+			return 0;
+		const RenderPass& src = _passes[in.pass];
+		if (in.previous_frame && src.double_buffered)
+			return src.textures[1 - src.write_index];
+		return src.textures[src.write_index];
+	}
+
+	// Reset in, giving back a texture it holds from TextureCache.
+	void _ReleaseChannel(ChannelInput& in)
+	{
+		if (in.type == ChannelInput::TEXTURE && in.cached)
+			TextureCache::instance().release(in.texture);
+		in = ChannelInput();
+	}
+
+	void _ApplyProgramState(RenderPass& pass)
+	{
+		glm::vec3 resolution[4];
+		for (int c = 0; c < 4; c++){
+			pass.u_channels[c] = pass.shader.uniform<Sampler>(SHADERTOY_CHANNEL_NAMES[c]);
+			pass.shader.set(pass.u_channels[c], c);
+			const ChannelInput& in = pass.channels[c];
+			if (in.type == ChannelInput::PASS)
+				resolution[c] = glm::vec3(_width, _height, 1.0f);
+			else if (in.type == ChannelInput::TEXTURE)
+				resolution[c] = in.resolution;
+			else
+				resolution[c] = glm::vec3(0.0f);
+		}
+		pass.u_channel_resolution = pass.shader.uniform<glm::vec3>("iChannelResolution");
+		pass.shader.set(pass.u_channel_resolution, resolution, 4);
+		pass.u_tile_offset = Uniform<glm::vec2>();
+		pass.u_interleave = Uniform<glm::vec2>();
+		if (_frag_coord_remap){
+			pass.u_tile_offset = pass.shader.uniform<glm::vec2>("iTileOffset");
+			pass.shader.set(pass.u_tile_offset, _tile_offset);
+			pass.u_interleave = pass.shader.uniform<glm::vec2>("iInterleave");
+		}
+		pass.program_dirty = false;
+	}
+
+	void _AllocateTargets()
+	{
+		_ReleaseTargets();
+		for (int p = 0; p < PASS_IMAGE; p++){
+			RenderPass& pass = _passes[p];
+			if (!pass.active)
+				continue;
+			int count = pass.double_buffered ? 2 : 1;
+			glGenTextures(count, pass.textures);
+			glGenFramebuffers(count, pass.framebuffers);
+			for (int i = 0; i < count; i++){
+				glBindTexture(GL_TEXTURE_2D, pass.textures[i]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, _width, _height, 0, GL_RGBA, GL_FLOAT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffers[i]);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pass.textures[i], 0);
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+					printf("Framebuffer of %s is incomplete\n", PASS_NAMES[p]);
+				// feedback starts from black
+				glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.0f)[0]);
+			}
+			if (!pass.double_buffered)
+				pass.write_index = 0;
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void _ReleaseTargets()
+	{
+		for (int p = 0; p < PASS_IMAGE; p++){
+			RenderPass& pass = _passes[p];
+			for (int i = 0; i < 2; i++){
+				if (pass.textures[i]) glDeleteTextures(1, &pass.textures[i]);
+				if (pass.framebuffers[i]) glDeleteFramebuffers(1, &pass.framebuffers[i]);
+				pass.textures[i] = pass.framebuffers[i] = 0;
+			}
+		}
+	}
+
+	std::string _vert_path = "shader/fullscreen_vert.glsl";
+	RenderPass _passes[PASS_COUNT];
+	std::vector<int> _order;
+	int _width = 0;
+	int _height = 0;
+	glm::vec2 _tile_offset = glm::vec2(0.0f);
+	glm::vec2 _interleave = glm::vec2(1.0f, 0.0f);
+	bool _frag_coord_remap = false;
+	GpuTimer* _timer = NULL;
+	int _timer_scopes[PASS_COUNT];
+};
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <emmintrin.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "ThreadPool.h"
+
+enum ResampleFilter { RESAMPLE_BOX, RESAMPLE_KAISER, RESAMPLE_LANCZOS };
+
+// Resizes RGBA images, 8 bits per channel or 32-bit float (hdr), for mip
+// chains and any other scaling. Works in SSE2 with one pixel per register
+// and splits the destination rows into bands over a thread pool, with the
+// calling thread working too.
+//
+// Halving with RESAMPLE_BOX averages 2x2 blocks with the same rounding as
+// SOIL's mipmap_image() and gives the same bytes. RESAMPLE_KAISER (a
+// Kaiser-windowed sinc) and RESAMPLE_LANCZOS (Lanczos 3) are separable
+// filters, wider than the box, that keep smaller levels sharper. Their
+// negative lobes stay in the weights, so results can ring past the source
+// range; only the store clamps, to [0, 1] for 8 bits and to >= 0 for float.
+// Taps past the edges repeat the edge pixel. With srgb the color of 8-bit
+// images is filtered in linear light and encoded again, as GL does when it
+// generates mipmaps of sRGB textures, so dark and bright texels mix in the
+// right proportion; alpha is always linear.
+class Resampler
+{
+public:
+	// threads == 0 picks one per hardware thread; 1 works on the calling
+	// thread only.
+	explicit Resampler(unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		if (threads > 1)
+			_pool.reset(new ThreadPool(threads - 1, (size_t)-1));
+	}
+
+	// Shared by everything that builds mip chains.
+	static Resampler& instance()
+	{
+		static Resampler resampler;
+		return resampler;
+	}
+
+	size_t threads() const
+	{
+		return _pool ? _pool->size() + 1 : 1;
+	}
+
+	// The next mip level of src: max(1, width / 2) x max(1, height / 2).
+	void reduce(const unsigned char* src, int width, int height, bool hdr, unsigned char* dst, ResampleFilter filter, bool srgb)
+	{
+		int dw = std::max(1, width / 2), dh = std::max(1, height / 2);
+		if (filter != RESAMPLE_BOX){
+			resize(src, width, height, hdr, dst, dw, dh, filter, srgb);
+			return;
+		}
+		Image image = { src, width, height, hdr, srgb && !hdr, dst, dw, dh };
+		_Parallel(dh, width * 2, [&image](int first, int last){ _BoxRows(image, first, last); });
+	}
+
+	// Scale src (width x height) to dst (dst_width x dst_height), up or down.
+	void resize(const unsigned char* src, int width, int height, bool hdr, unsigned char* dst, int dst_width, int dst_height,
+		ResampleFilter filter, bool srgb)
+	{
+		Image image = { src, width, height, hdr, srgb && !hdr, dst, dst_width, dst_height };
+		Axis x = _Weights(width, dst_width, filter);
+		Axis y = _Weights(height, dst_height, filter);
+		_Parallel(dst_height, (dst_width + width) * x.taps, [&image, &x, &y](int first, int last){
+			_FilterRows(image, x, y, first, last);
+		});
+	}
+
+private:
+	struct Image
+	{
+		const unsigned char* src;
+		int width;
+		int height;
+		bool hdr;
+		bool srgb;
+		unsigned char* dst;
+		int dst_width;
+		int dst_height;
+	};
+
+	// Source taps of every destination pixel along one axis; taps per pixel
+	// is fixed, unused ones have weight 0. Weights are repeated four times,
+	// ready to multiply a pixel.
+	struct Axis
+	{
+		int taps = 0;
+		std::vector<int> index;
+		std::vector<float> weight;
+	};
+
+	struct SrgbTables
+	{
+		float to_linear[256];
+		unsigned short to_linear16[256];	// linear * 65535
+		unsigned char to_srgb[65536];		// indexed by linear * 65535
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++){
+				double c = i / 255.0;
+				double l = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+				to_linear[i] = (float)l;
+				to_linear16[i] = (unsigned short)(l * 65535.0 + 0.5);
+			}
+			for (int i = 0; i < 65536; i++){
+				double l = i / 65535.0;
+				double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+				to_srgb[i] = (unsigned char)(c * 255.0 + 0.5);
+			}
+		}
+	};
+
+	static const SrgbTables& _Srgb()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	// Rows in bands over the pool; small images stay on the calling thread,
+	// where handing out bands would cost more than it saves.
+	void _Parallel(int rows, int row_cost, const std::function<void(int, int)>& work)
+	{
+		long long cost = (long long)rows * row_cost;
+		ThreadPool* pool = cost >= 65536 ? _pool.get() : NULL;
+		parallel_bands(pool, rows, (int)threads() * 4, work);
+	}
+
+	// 2x2 averages of rows [first, last) of dst; odd edges repeat their last
+	// row or column.
+	static void _BoxRows(const Image& image, int first, int last)
+	{
+		int sw = image.width, sh = image.height, dw = image.dst_width;
+		size_t pixel = image.hdr ? 16 : 4;
+		for (int y = first; y < last; y++){
+			const unsigned char* r0 = image.src + (size_t)std::min(2 * y, sh - 1) * sw * pixel;
+			const unsigned char* r1 = image.src + (size_t)std::min(2 * y + 1, sh - 1) * sw * pixel;
+			unsigned char* out = image.dst + (size_t)y * dw * pixel;
+			int x = 0;
+			if (image.hdr){
+				const __m128 quarter = _mm_set1_ps(0.25f);
+				for (; x < dw; x++){
+					int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+					__m128 a = _mm_loadu_ps((const float*)r0 + x0 * 4), b = _mm_loadu_ps((const float*)r0 + x1 * 4);
+					__m128 c = _mm_loadu_ps((const float*)r1 + x0 * 4), d = _mm_loadu_ps((const float*)r1 + x1 * 4);
+					_mm_storeu_ps((float*)out + x * 4, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter));
+				}
+			}
+			else if (image.srgb){
+				// table lookups do not vectorize in SSE2; 16-bit linear sums are
+				// exact and alpha rounds as in the linear case
+				const SrgbTables& tables = _Srgb();
+				const unsigned short* linear = tables.to_linear16;
+				for (; x < dw; x++){
+					const unsigned char* a = r0 + std::min(2 * x, sw - 1) * 4;
+					const unsigned char* b = r0 + std::min(2 * x + 1, sw - 1) * 4;
+					const unsigned char* c = r1 + std::min(2 * x, sw - 1) * 4;
+					const unsigned char* d = r1 + std::min(2 * x + 1, sw - 1) * 4;
+					for (int k = 0; k < 3; k++)
+						out[x * 4 + k] = tables.to_srgb[(linear[a[k]] + linear[b[k]] + linear[c[k]] + linear[d[k]] + 2) >> 2];
+					out[x * 4 + 3] = (unsigned char)((a[3] + b[3] + c[3] + d[3] + 2) >> 2);
+				}
+			}
+			else{
+				// four destination pixels from eight source pixels of each row
+				const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+				for (; x + 4 <= dw && 2 * x + 8 <= sw; x += 4){
+					__m128i e0, o0, e1, o1;
+					_Split(r0 + x * 8, e0, o0);
+					_Split(r1 + x * 8, e1, o1);
+					__m128i low = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(e0, zero), _mm_unpacklo_epi8(o0, zero)),
+						_mm_add_epi16(_mm_unpacklo_epi8(e1, zero), _mm_unpacklo_epi8(o1, zero)));
+					__m128i high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(e0, zero), _mm_unpackhi_epi8(o0, zero)),
+						_mm_add_epi16(_mm_unpackhi_epi8(e1, zero), _mm_unpackhi_epi8(o1, zero)));
+					low = _mm_srli_epi16(_mm_add_epi16(low, two), 2);
+					high = _mm_srli_epi16(_mm_add_epi16(high, two), 2);
+					_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(low, high));
+				}
+				for (; x < dw; x++){
+					int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+					for (int k = 0; k < 4; k++)
+						out[x * 4 + k] = (unsigned char)((r0[x0 * 4 + k] + r0[x1 * 4 + k] + r1[x0 * 4 + k] + r1[x1 * 4 + k] + 2) >> 2);
+				}
+			}
+		}
+	}
+
+	// Even and odd pixels of eight RGBA8 pixels.
+	static void _Split(const unsigned char* p, __m128i& even, __m128i& odd)
+	{
+		__m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)p));
+		__m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(p + 16)));
+		even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	// An RGBA8 pixel as linear floats in [0, 1].
+	static __m128 _Linear(const unsigned char* p, const SrgbTables& tables)
+	{
+		return _mm_setr_ps(tables.to_linear[p[0]], tables.to_linear[p[1]], tables.to_linear[p[2]], p[3] * (1.0f / 255.0f));
+	}
+
+	static __m128 _Unorm(const unsigned char* p)
+	{
+		__m128i v = _mm_cvtsi32_si128(*(const int*)p);
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_setzero_si128());
+		return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+	}
+
+	// Round a pixel in [0, 1] back to 8 bits, through sRGB if asked.
+	static void _Store8(__m128 v, unsigned char* out, bool srgb, const SrgbTables& tables)
+	{
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		if (srgb){
+			int index[4];
+			_mm_storeu_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(65535.0f)), _mm_set1_ps(0.5f))));
+			out[0] = tables.to_srgb[index[0]];
+			out[1] = tables.to_srgb[index[1]];
+			out[2] = tables.to_srgb[index[2]];
+			out[3] = (unsigned char)(_mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))) * 255.0f + 0.5f);
+			return;
+		}
+		__m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+		i = _mm_packs_epi32(i, i);
+		*(int*)out = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+	}
+
+	static double _Sinc(double x)
+	{
+		x *= 3.14159265358979323846;
+		return fabs(x) < 1e-8 ? 1.0 : sin(x) / x;
+	}
+
+	static double _BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++){
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	static double _Radius(ResampleFilter filter)
+	{
+		return filter == RESAMPLE_BOX ? 0.5 : 3.0;
+	}
+
+	static double _Kernel(ResampleFilter filter, double x)
+	{
+		// half-open, so the source pixel under every sample point counts even
+		// when upscaling puts it exactly on a boundary
+		if (filter == RESAMPLE_BOX)
+			return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+		x = fabs(x);
+		if (x >= 3.0)
+			return 0.0;
+		if (filter == RESAMPLE_LANCZOS)
+			return _Sinc(x) * _Sinc(x / 3.0);
+		// Kaiser window with alpha 4 over the same three lobes
+		const double alpha = 4.0;
+		double t = x / 3.0;
+		return _Sinc(x) * _BesselI0(alpha * sqrt(1.0 - t * t)) / _BesselI0(alpha);
+	}
+
+	// Downscaling stretches the filter over scale source pixels, so every
+	// source pixel contributes.
+	static Axis _Weights(int src, int dst, ResampleFilter filter)
+	{
+		Axis axis;
+		double scale = (double)src / dst;
+		double stretch = std::max(1.0, scale);
+		double support = _Radius(filter) * stretch;
+		axis.taps = (int)ceil(2.0 * support) + 1;
+		axis.index.resize((size_t)dst * axis.taps);
+		axis.weight.resize((size_t)dst * axis.taps * 4);
+		std::vector<double> weights(axis.taps);
+		for (int d = 0; d < dst; d++){
+			double center = (d + 0.5) * scale;
+			int first = (int)floor(center - support);
+			double sum = 0.0;
+			for (int t = 0; t < axis.taps; t++){
+				weights[t] = _Kernel(filter, (first + t + 0.5 - center) / stretch);
+				axis.index[d * axis.taps + t] = std::min(std::max(first + t, 0), src - 1);
+				sum += weights[t];
+			}
+			for (int t = 0; t < axis.taps; t++)
+				for (int k = 0; k < 4; k++)
+					axis.weight[((size_t)d * axis.taps + t) * 4 + k] = (float)(weights[t] / sum);
+		}
+		return axis;
+	}
+
+	// Rows [first, last) of dst. Source rows are filtered horizontally into a
+	// ring of y.taps rows as they are first needed; the rows of consecutive
+	// destination rows only move forward, so each is filtered once per band
+	// and the ring stays in cache.
+	static void _FilterRows(const Image& image, const Axis& x, const Axis& y, int first, int last)
+	{
+		int dw = image.dst_width;
+		const SrgbTables& tables = _Srgb();
+		std::vector<float> source((size_t)image.width * 4);
+		std::vector<float> ring((size_t)y.taps * dw * 4);
+		std::vector<int> ring_rows(y.taps, -1);
+		std::vector<float> row((size_t)dw * 4);
+		size_t pixel = image.hdr ? 16 : 4;
+		for (int d = first; d < last; d++){
+			std::fill(row.begin(), row.end(), 0.0f);
+			for (int t = 0; t < y.taps; t++){
+				const float* w = &y.weight[((size_t)d * y.taps + t) * 4];
+				if (w[0] == 0.0f)
+					continue;
+				int r = y.index[(size_t)d * y.taps + t];
+				float* in = &ring[(size_t)(r % y.taps) * dw * 4];
+				if (ring_rows[r % y.taps] != r){
+					_LoadRow(image, r, &source[0], tables);
+					_FilterRow(x, &source[0], in, dw);
+					ring_rows[r % y.taps] = r;
+				}
+				__m128 weight = _mm_loadu_ps(w);
+				for (int i = 0; i < dw * 4; i += 4)
+					_mm_storeu_ps(&row[i], _mm_add_ps(_mm_loadu_ps(&row[i]), _mm_mul_ps(weight, _mm_loadu_ps(in + i))));
+			}
+			unsigned char* out = image.dst + (size_t)d * dw * pixel;
+			for (int i = 0; i < dw; i++){
+				__m128 v = _mm_loadu_ps(&row[i * 4]);
+				if (image.hdr)
+					_mm_storeu_ps((float*)out + i * 4, _mm_max_ps(v, _mm_setzero_ps()));
+				else
+					_Store8(v, out + i * 4, image.srgb, tables);
+			}
+		}
+	}
+
+	static void _FilterRow(const Axis& x, const float* source, float* out, int dw)
+	{
+		for (int d = 0; d < dw; d++){
+			const int* index = &x.index[(size_t)d * x.taps];
+			const float* weight = &x.weight[(size_t)d * x.taps * 4];
+			__m128 sum = _mm_setzero_ps();
+			for (int t = 0; t < x.taps; t++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(weight + t * 4), _mm_loadu_ps(source + index[t] * 4)));
+			_mm_storeu_ps(out + d * 4, sum);
+		}
+	}
+
+	// Source row r as floats, linear light for sRGB.
+	static void _LoadRow(const Image& image, int r, float* out, const SrgbTables& tables)
+	{
+		int width = image.width;
+		if (image.hdr){
+			memcpy(out, image.src + (size_t)r * width * 16, (size_t)width * 16);
+			return;
+		}
+		const unsigned char* in = image.src + (size_t)r * width * 4;
+		int i = 0;
+		if (!image.srgb){
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			for (; i + 4 <= width; i += 4){
+				__m128i v = _mm_loadu_si128((const __m128i*)(in + i * 4));
+				__m128i low = _mm_unpacklo_epi8(v, zero), high = _mm_unpackhi_epi8(v, zero);
+				_mm_storeu_ps(out + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+				_mm_storeu_ps(out + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+				_mm_storeu_ps(out + i * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+				_mm_storeu_ps(out + i * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+			}
+		}
+		for (; i < width; i++)
+			_mm_storeu_ps(out + i * 4, image.srgb ? _Linear(in + i * 4, tables) : _Unorm(in + i * 4));
+	}
+
+	std::unique_ptr<ThreadPool> _pool;
+};
+
+#endif
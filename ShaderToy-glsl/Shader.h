@@ -4,14 +4,91 @@
 #include <glew.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <set>
+#include <algorithm>
+#include <stdio.h>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <chrono>
+#include <memory>
+#include "ShaderToyInputs.h"
+#include "ProgramCache.h"
+#include "FileWatcher.h"
 using namespace std;
 
+// Counters for the GL calls issued through Shader's uniform API.
+struct ShaderStats{
+	unsigned long long location_queries = 0;	// glGetUniformLocation / glGetActiveUniform calls
+	unsigned long long uniform_uploads = 0;		// glUniform* calls
+	unsigned long long skipped_binds = 0;		// binds to uniforms the program doesn't use
+};
+
+// Pre-resolved location of an active uniform. T is the C++ type the uniform
+// is written with; a handle that failed to resolve has location -1 and every
+// set() through it is a no-op.
+template <typename T>
+struct Uniform{
+	GLint location;
+	GLint size;
+
+	Uniform() : location(-1), size(0){}
+	explicit Uniform(GLint loc, GLint n = 1) : location(loc), size(n){}
+
+	bool valid() const{
+		return location != -1;
+	}
+};
+
+// Marker type for sampler uniforms, written with a texture unit index.
+struct Sampler{};
+
+// State of a program build submitted with Shader::begin_build(). The driver
+// may compile and link it in the background; is_ready() never blocks.
+struct ProgramBuild{
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+	std::vector<std::string> dependencies;	// every file read, includes too
+	std::chrono::high_resolution_clock::time_point start;
+	hash64_t cache_key = 0;
+	GLuint vertex_shader = 0;
+	GLuint fragment_shader = 0;
+	GLuint program = 0;		// owned until handed to a Shader
+	bool from_cache = false;
+	bool finished = false;
+	bool linked = false;
+
+	~ProgramBuild(){
+		if (vertex_shader) glDeleteShader(vertex_shader);
+		if (fragment_shader) glDeleteShader(fragment_shader);
+		if (program) glDeleteProgram(program);
+	}
+
+	// True once finish_build() can run without stalling. Without parallel
+	// compile support the driver gives no completion status, so the build is
+	// reported ready right away and finishing it blocks.
+	bool is_ready() const{
+		if (finished || from_cache || program == 0)
+			return true;
+		if (!GLEW_ARB_parallel_shader_compile)
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &done);
+		return done == GL_TRUE;
+	}
+};
+typedef std::shared_ptr<ProgramBuild> ProgramBuildHandle;
+
 class Shader{
 public:
+	// One entry of the active uniform table built at link time.
+	struct UniformInfo{
+		std::string name;	// array uniforms are stored without the "[0]" suffix
+		GLint location;
+		GLenum type;
+		GLint size;
+	};
+
 	Shader(){
 	}
 
@@ -19,17 +96,159 @@ public:
 		glDeleteProgram(_program);
 	}
 
-	void init(const char* vert_prog_path, const char* frag_prog_path){
-		_program = LoadShaders(vert_prog_path, frag_prog_path);
+	// use_inputs_block: declare the ShaderToyInputs uniform block in the
+	// fragment shader and drop loose declarations of the built-ins.
+	// remap_frag_coord: read gl_FragCoord on the virtual canvas of tiled and
+	// interleaved rendering (iTileOffset, iInterleave); needs use_inputs_block.
+	void init(const char* vert_prog_path, const char* frag_prog_path, bool use_inputs_block = true, bool remap_frag_coord = false){
+		_SetSources(vert_prog_path, frag_prog_path, use_inputs_block, remap_frag_coord);
+		ProgramBuildHandle build = begin_build(_vert_path.c_str(), _frag_path.c_str(), use_inputs_block, remap_frag_coord);
+		_dependencies = build->dependencies;
+		_program = finish_build(*build);
+		// a failed build keeps its program, for ~ProgramBuild to delete
+		if (_program != 0)
+			build->program = 0;
+		_ReflectUniforms();
+	}
+
+	// Start building a new program for this shader without blocking. The
+	// current program (if any) stays in use until poll() swaps the new one in.
+	// Builds started for several shaders back to back compile concurrently.
+	ProgramBuildHandle init_async(const char* vert_prog_path, const char* frag_prog_path, bool use_inputs_block = true, bool remap_frag_coord = false){
+		_SetSources(vert_prog_path, frag_prog_path, use_inputs_block, remap_frag_coord);
+		_pending = begin_build(_vert_path.c_str(), _frag_path.c_str(), use_inputs_block, remap_frag_coord);
+		_dependencies = _pending->dependencies;
+		return _pending;
+	}
+
+	// Rebuild from the same sources in the background (hot-reload).
+	ProgramBuildHandle reload(){
+		return init_async(_vert_path.c_str(), _frag_path.c_str(), _use_inputs_block, _remap_frag_coord);
+	}
+
+	// True if path (normalized) is one of the files the last build read.
+	bool depends_on(const std::string& path) const{
+		return std::find(_dependencies.begin(), _dependencies.end(), path) != _dependencies.end();
+	}
+
+	const std::vector<std::string>& dependencies() const{
+		return _dependencies;
+	}
+
+	// Swap in the pending program once the driver has finished it. A build
+	// that fails to compile or link is dropped and the old program is kept.
+	// Returns true when a new program was swapped in.
+	bool poll(){
+		if (!_pending || !_pending->is_ready())
+			return false;
+		return finish();
+	}
+
+	// Block until the pending build (if any) is finished and swapped in.
+	bool finish(){
+		if (!_pending)
+			return false;
+		ProgramBuildHandle build = _pending;
+		_pending.reset();
+		GLuint program = finish_build(*build);
+		if (program == 0)
+			return false;
+		build->program = 0;
+		glDeleteProgram(_program);
+		_program = program;
+		_ReflectUniforms();
+		return true;
+	}
+
+	// A program is available for use(); false while the first build runs.
+	bool ready() const{
+		return _program != 0;
+	}
+
+	bool building() const{
+		return (bool)_pending;
 	}
 
 	void use(){
 		glUseProgram(_program);
 	}
 
+	// Typed handle lookup. Resolves against the reflected table, so no GL call
+	// is made; resolve handles once and keep them around for per-frame binds.
+	template <typename T>
+	Uniform<T> uniform(const char* name) const{
+		Uniform<T> u;
+		const UniformInfo* info = find_uniform(name);
+		if (info == NULL)
+			return u;
+		if (!uniform_type_matches<T>(info->type)){
+			printf("uniform [%s] has GL type 0x%04X, which does not match the requested handle type\n", name, info->type);
+			return u;
+		}
+		return Uniform<T>(info->location, info->size);
+	}
+
+	void set(Uniform<bool> u, const bool b){
+		if (_skip(u.location)) return;
+		glUniform1i(u.location, b);
+	}
+
+	void set(Uniform<int> u, const int i){
+		if (_skip(u.location)) return;
+		glUniform1i(u.location, i);
+	}
+
+	void set(Uniform<float> u, const float f){
+		if (_skip(u.location)) return;
+		glUniform1f(u.location, f);
+	}
+
+	void set(Uniform<glm::vec2> u, glm::vec2 const & vec){
+		if (_skip(u.location)) return;
+		glUniform2fv(u.location, 1, &vec[0]);
+	}
+
+	void set(Uniform<glm::vec3> u, glm::vec3 const & vec){
+		if (_skip(u.location)) return;
+		glUniform3fv(u.location, 1, &vec[0]);
+	}
+
+	void set(Uniform<glm::vec4> u, glm::vec4 const & vec){
+		if (_skip(u.location)) return;
+		glUniform4fv(u.location, 1, &vec[0]);
+	}
+
+	void set(Uniform<glm::vec3> u, const glm::vec3* vec, GLsizei count){
+		if (_skip(u.location)) return;
+		glUniform3fv(u.location, count, glm::value_ptr(vec[0]));
+	}
+
+	void set(Uniform<glm::vec4> u, const glm::vec4* vec, GLsizei count){
+		if (_skip(u.location)) return;
+		glUniform4fv(u.location, count, glm::value_ptr(vec[0]));
+	}
+
+	void set(Uniform<glm::mat4> u, glm::mat4 const & mat){
+		if (_skip(u.location)) return;
+		glUniformMatrix4fv(u.location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	// Point a sampler at a texture unit. Sampler values persist in the
+	// program, so this only needs to happen after a (re)link.
+	void set(Uniform<Sampler> u, GLint unit){
+		if (_skip(u.location)) return;
+		glUniform1i(u.location, unit);
+	}
+
+	void set(Uniform<Sampler> u, GLuint texture, GLuint id, GLenum texture_type = GL_TEXTURE_2D){
+		glActiveTexture(GLenum(GL_TEXTURE0 + id));
+		glBindTexture(texture_type, texture);
+		if (_skip(u.location)) return;
+		glUniform1i(u.location, id);
+	}
+
 	void bind_mat4(const char* name, glm::mat4 const & mat){
-		GLint loc = get_uniform_loc(name);
-		glUniformMatrix4fv(loc, 1, GL_FALSE, &mat[0][0]);
+		set(Uniform<glm::mat4>(get_uniform_loc(name)), mat);
 	}
 
 	void bind_bool(const char* name, const bool b){
@@ -37,155 +256,331 @@ public:
 	}
 
 	void bind_int(const char* name, const int i){
-		GLint loc = get_uniform_loc(name);
-		glUniform1i(loc, i);
+		set(Uniform<int>(get_uniform_loc(name)), i);
 	}
 
 	void bind_float(const char* name, const float f){
-		GLint loc = get_uniform_loc(name);
-		glUniform1f(loc, f);
+		set(Uniform<float>(get_uniform_loc(name)), f);
 	}
 
 	void bind_vec2(const char* name, glm::vec2 const & vec){
-		GLint loc = get_uniform_loc(name);
-		glUniform2fv(loc, 1, &vec[0]);
+		set(Uniform<glm::vec2>(get_uniform_loc(name)), vec);
 	}
 
 	void bind_vec3(const char* name, glm::vec3 const & vec){
-		GLint loc = get_uniform_loc(name);
-		glUniform3fv(loc, 1, &vec[0]);
+		set(Uniform<glm::vec3>(get_uniform_loc(name)), vec);
 	}
 
 	void bind_vec4_array(const char* name, std::vector<glm::vec4> vec){
-		GLint loc = get_uniform_loc(name);
-		glUniform4fv(loc, (GLsizei)vec.size(), glm::value_ptr(vec[0]));
+		if (vec.empty()) return;
+		set(Uniform<glm::vec4>(get_uniform_loc(name)), &vec[0], (GLsizei)vec.size());
 	}
 
 	void bind_texture(const char* name, GLuint texture, GLuint id, GLenum texture_type = GL_TEXTURE_2D){
-		glActiveTexture(GLenum(GL_TEXTURE0 + id));
-		glBindTexture(texture_type, texture);
-		GLuint loc = glGetUniformLocation(_program, name);
-		glUniform1i(loc, id);
+		set(Uniform<Sampler>(get_uniform_loc(name)), texture, id, texture_type);
 	}
 
 	GLuint get_program(){
 		return _program;
 	}
 
-private:
-	static GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path){
-		// Create the shaders
-		GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-		GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	const std::vector<UniformInfo>& uniforms() const{
+		return _uniforms;
+	}
 
-		// Read the Vertex Shader code from the file
-		std::string VertexShaderCode;
-		std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-		if (VertexShaderStream.is_open()) {
-			std::string Line = "";
-			while (getline(VertexShaderStream, Line))
-				VertexShaderCode += "\n" + Line;
-			VertexShaderStream.close();
+	const UniformInfo* find_uniform(const char* name) const{
+		// _uniforms is sorted by name
+		size_t lo = 0, hi = _uniforms.size();
+		while (lo < hi){
+			size_t mid = (lo + hi) / 2;
+			int c = _uniforms[mid].name.compare(name);
+			if (c == 0)
+				return &_uniforms[mid];
+			if (c < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
 		}
-		else {
+		return NULL;
+	}
+
+	static ShaderStats& stats(){
+		static ShaderStats s;
+		return s;
+	}
+
+	// Allow the driver to compile and link on its own threads. Call once after
+	// the context is created; without GL_ARB_parallel_shader_compile (the ARB
+	// alias of KHR_parallel_shader_compile) builds still work but block in
+	// finish_build().
+	static void enable_parallel_compile(){
+		if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+
+	// Issue the build of a program without waiting for the driver: sources are
+	// read and preprocessed, the cache is checked and, on a miss, compile and
+	// link are submitted. Poll the returned handle with is_ready().
+	static ProgramBuildHandle begin_build(const char * vertex_file_path, const char * fragment_file_path, bool use_inputs_block, bool remap_frag_coord = false){
+		ProgramBuildHandle build = std::make_shared<ProgramBuild>();
+		build->vertex_file_path = vertex_file_path;
+		build->fragment_file_path = fragment_file_path;
+		build->start = std::chrono::high_resolution_clock::now();
+
+		// Read the shader sources, expanding #include directives
+		std::string VertexShaderCode;
+		if (!_ReadSource(vertex_file_path, VertexShaderCode, build->dependencies, 0)) {
 			printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-			getchar();
-			return 0;
+			build->finished = true;
+			return build;
 		}
-
-		// Read the Fragment Shader code from the file
 		std::string FragmentShaderCode;
-		std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-		if (FragmentShaderStream.is_open()) {
-			std::string Line = "";
-			while (getline(FragmentShaderStream, Line))
-				FragmentShaderCode += "\n" + Line;
-			FragmentShaderStream.close();
+		if (!_ReadSource(fragment_file_path, FragmentShaderCode, build->dependencies, 0)) {
+			printf("Impossible to open %s.\n", fragment_file_path);
+			build->finished = true;
+			return build;
+		}
+		if (use_inputs_block)
+			FragmentShaderCode = shadertoy_inputs_preamble(FragmentShaderCode, remap_frag_coord);
+
+		// Try the program binary cache before compiling from source
+		ProgramCache& Cache = ProgramCache::instance();
+		build->cache_key = Cache.key(VertexShaderCode, FragmentShaderCode);
+		build->program = Cache.load(build->cache_key);
+		if (build->program != 0) {
+			build->from_cache = true;
+			return build;
 		}
 
-		GLint Result = GL_FALSE;
-		int InfoLogLength;
+		// Create the shaders
+		build->vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+		build->fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
 
 		// Compile Vertex Shader
-		//printf("Compiling shader : %s\n", vertex_file_path);
 		char const * VertexSourcePointer = VertexShaderCode.c_str();
-		glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-		glCompileShader(VertexShaderID);
+		glShaderSource(build->vertex_shader, 1, &VertexSourcePointer, NULL);
+		glCompileShader(build->vertex_shader);
+
+		// Compile Fragment Shader
+		char const * FragmentSourcePointer = FragmentShaderCode.c_str();
+		glShaderSource(build->fragment_shader, 1, &FragmentSourcePointer, NULL);
+		glCompileShader(build->fragment_shader);
+
+		// Link the program; status is only queried in finish_build() so the
+		// driver is free to keep working in the background.
+		build->program = glCreateProgram();
+		glAttachShader(build->program, build->vertex_shader);
+		glAttachShader(build->program, build->fragment_shader);
+		glProgramParameteri(build->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(build->program);
+		return build;
+	}
+
+	// Check the status of a build, print its logs and store it in the cache.
+	// Blocks if the driver has not finished yet. Returns the program, or 0 if
+	// compiling or linking failed.
+	static GLuint finish_build(ProgramBuild& build){
+		if (build.finished)
+			return build.linked ? build.program : 0;
+		build.finished = true;
+		if (build.from_cache) {
+			build.linked = true;
+			_BindInputsBlock(build.program);
+			return build.program;
+		}
+
+		GLint Result = GL_FALSE;
+		int InfoLogLength;
 
 		// Check Vertex Shader
-		glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-		glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		glGetShaderiv(build.vertex_shader, GL_COMPILE_STATUS, &Result);
+		glGetShaderiv(build.vertex_shader, GL_INFO_LOG_LENGTH, &InfoLogLength);
 		if (InfoLogLength > 0) {
 			std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
+			glGetShaderInfoLog(build.vertex_shader, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
 			if (VertexShaderErrorMessage[0] != '\0')
-				printf("Error when compiling vertex shader: %s\n%s\n", vertex_file_path, &VertexShaderErrorMessage[0]);
+				printf("Error when compiling vertex shader: %s\n%s\n", build.vertex_file_path.c_str(), &VertexShaderErrorMessage[0]);
 		}
-		// Compile Fragment Shader
-		//printf("Compiling shader : %s\n", fragment_file_path);
-		char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-		glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-		glCompileShader(FragmentShaderID);
 
 		// Check Fragment Shader
-		glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-		glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		glGetShaderiv(build.fragment_shader, GL_COMPILE_STATUS, &Result);
+		glGetShaderiv(build.fragment_shader, GL_INFO_LOG_LENGTH, &InfoLogLength);
 		if (InfoLogLength > 0) {
 			std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
+			glGetShaderInfoLog(build.fragment_shader, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
 			if (FragmentShaderErrorMessage[0] != '\0')
-				printf("Error when compiling fragment shader: %s\n%s\n", fragment_file_path, &FragmentShaderErrorMessage[0]);
+				printf("Error when compiling fragment shader: %s\n%s\n", build.fragment_file_path.c_str(), &FragmentShaderErrorMessage[0]);
 		}
-		// Link the program
-		//printf("Linking program\n");
-		GLuint ProgramID = glCreateProgram();
-		glAttachShader(ProgramID, VertexShaderID);
-		glAttachShader(ProgramID, FragmentShaderID);
-		glLinkProgram(ProgramID);
 
 		// Check the program
-		glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		glGetProgramiv(build.program, GL_LINK_STATUS, &Result);
+		glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &InfoLogLength);
 		if (InfoLogLength > 0) {
 			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+			glGetProgramInfoLog(build.program, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 			if (ProgramErrorMessage[0] != '\0')
-				printf("Error when linking %s and %s\n%s\n", vertex_file_path, fragment_file_path, &ProgramErrorMessage[0]);
+				printf("Error when linking %s and %s\n%s\n", build.vertex_file_path.c_str(), build.fragment_file_path.c_str(), &ProgramErrorMessage[0]);
 		}
 
-		glDeleteShader(VertexShaderID);
-		glDeleteShader(FragmentShaderID);
+		glDeleteShader(build.vertex_shader);
+		glDeleteShader(build.fragment_shader);
+		build.vertex_shader = build.fragment_shader = 0;
+
+		build.linked = Result == GL_TRUE;
+		if (!build.linked)
+			return 0;
+		double CompileMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build.start).count();
+		ProgramCache::instance().store(build.cache_key, build.program, CompileMs);
+		_BindInputsBlock(build.program);
+		return build.program;
+	}
+
+private:
+	// Read path into code, replacing each '#include "file"' line (relative to
+	// the including file) with the file's contents. Every file read is added
+	// to dependencies so hot-reload can tell which programs an edit touches.
+	// Each line is followed by '\n', so line N of code is line N of the file
+	// until the first include, and #line directives keep it so after each.
+	static bool _ReadSource(const std::string& path, std::string& code, std::vector<std::string>& dependencies, int depth){
+		// recorded even if it can not be opened, so creating it triggers a reload
+		std::string normalized = normalize_path(path);
+		if (std::find(dependencies.begin(), dependencies.end(), normalized) == dependencies.end())
+			dependencies.push_back(normalized);
+		std::ifstream Stream(path.c_str(), std::ios::in);
+		if (!Stream.is_open())
+			return false;
+
+		std::string Line = "";
+		int LineNumber = 0;
+		while (getline(Stream, Line)) {
+			LineNumber++;
+			size_t hash = Line.find_first_not_of(" \t");
+			if (hash != std::string::npos && Line.compare(hash, 8, "#include") == 0) {
+				size_t open = Line.find('"', hash);
+				size_t close = open == std::string::npos ? open : Line.find('"', open + 1);
+				if (close == std::string::npos || depth >= 16) {
+					printf("Bad #include in %s line %d\n", path.c_str(), LineNumber);
+					code += "\n";
+					continue;
+				}
+				std::string include = directory_of(path) + "/" + Line.substr(open + 1, close - open - 1);
+				if (!_ReadSource(include, code, dependencies, depth + 1))
+					printf("Impossible to open %s included from %s\n", include.c_str(), path.c_str());
+				char directive[32];
+				sprintf(directive, "#line %d\n", LineNumber + 1);
+				code += directive;
+				continue;
+			}
+			code += Line + "\n";
+		}
+		return true;
+	}
 
-		return ProgramID;
+	static void _BindInputsBlock(GLuint program){
+		GLuint BlockIndex = glGetUniformBlockIndex(program, "ShaderToyInputs");
+		if (BlockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, BlockIndex, SHADERTOY_INPUTS_BINDING);
 	}
 
 private:
 
-	static std::set<std::string> uniform_not_found;
+	template <typename T> static bool uniform_type_matches(GLenum type);
+
+	std::set<std::string> _uniform_not_found;
+	std::vector<UniformInfo> _uniforms;
 	GLuint _program = 0;
+	ProgramBuildHandle _pending;
+	std::string _vert_path;
+	std::string _frag_path;
+	bool _use_inputs_block = true;
+	bool _remap_frag_coord = false;
+	std::vector<std::string> _dependencies;
+
+	void _SetSources(const char* vert_prog_path, const char* frag_prog_path, bool use_inputs_block, bool remap_frag_coord){
+		// copy first, reload() passes pointers into these strings
+		std::string vert = vert_prog_path, frag = frag_prog_path;
+		_vert_path = vert;
+		_frag_path = frag;
+		_use_inputs_block = use_inputs_block;
+		_remap_frag_coord = remap_frag_coord;
+	}
 
-	GLint get_uniform_loc(const char * name){
-		GLint loc = glGetUniformLocation(_program, name);
+	// Enumerate the active uniforms of the linked program into _uniforms.
+	void _ReflectUniforms(){
+		_uniforms.clear();
+		if (_program == 0)
+			return;
+
+		GLint count = 0, max_length = 0;
+		glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+		std::vector<char> name(max_length + 1);
+		_uniforms.reserve(count);
+		for (GLint i = 0; i < count; i++){
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = GL_NONE;
+			glGetActiveUniform(_program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			stats().location_queries++;
+			std::string str(&name[0], length);
+			if (str.size() > 3 && str.compare(str.size() - 3, 3, "[0]") == 0)
+				str.resize(str.size() - 3);
+			// members of uniform blocks have no location
+			GLint loc = glGetUniformLocation(_program, &name[0]);
+			stats().location_queries++;
+			if (loc == -1)
+				continue;
+			UniformInfo info = { str, loc, type, size };
+			_uniforms.push_back(info);
+		}
+		std::sort(_uniforms.begin(), _uniforms.end(),
+			[](const UniformInfo& a, const UniformInfo& b){ return a.name < b.name; });
+	}
 
-		if (loc == -1)
+	bool _skip(GLint loc){
+		if (loc == -1){
+			stats().skipped_binds++;
+			return true;
+		}
+		stats().uniform_uploads++;
+		return false;
+	}
+
+	GLint get_uniform_loc(const char * name){
+		const UniformInfo* info = find_uniform(name);
+		if (info == NULL)
 		{
-			//	std::cout << "uniform [" + string(name) + "] not found!" << std::endl;
 #if DEBUG || _DEBUG
-			if (uniform_not_found.find(name) == uniform_not_found.end())
+			if (_uniform_not_found.find(name) == _uniform_not_found.end())
 			{
-				Debug::LogError("uniform [" + std::string(name) + "] not found!");
-				uniform_not_found.insert(name);
+				printf("uniform [%s] not found!\n", name);
+				_uniform_not_found.insert(name);
 			}
-#else
-			//Debug::LogError("uniform [" + std::string(name) + "] not found!");
 #endif // DEBUG
-
-
+			return -1;
 		}
-		return loc;
+		return info->location;
 	}
 
 
 };
 
+template <typename T> inline bool Shader::uniform_type_matches(GLenum type){ return false; }
+template <> inline bool Shader::uniform_type_matches<bool>(GLenum type){ return type == GL_BOOL || type == GL_INT; }
+template <> inline bool Shader::uniform_type_matches<int>(GLenum type){ return type == GL_INT || type == GL_BOOL; }
+template <> inline bool Shader::uniform_type_matches<float>(GLenum type){ return type == GL_FLOAT; }
+template <> inline bool Shader::uniform_type_matches<glm::vec2>(GLenum type){ return type == GL_FLOAT_VEC2; }
+template <> inline bool Shader::uniform_type_matches<glm::vec3>(GLenum type){ return type == GL_FLOAT_VEC3; }
+template <> inline bool Shader::uniform_type_matches<glm::vec4>(GLenum type){ return type == GL_FLOAT_VEC4; }
+template <> inline bool Shader::uniform_type_matches<glm::mat4>(GLenum type){ return type == GL_FLOAT_MAT4; }
+template <> inline bool Shader::uniform_type_matches<Sampler>(GLenum type){
+	switch (type){
+	case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_SHADOW: case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+		return true;
+	default:
+		return false;
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,285 @@
+#ifndef SHADERTOY_INPUTS_H
+#define SHADERTOY_INPUTS_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+
+// Uniform buffer binding point every program's ShaderToyInputs block is tied to.
+#define SHADERTOY_INPUTS_BINDING 0
+
+// CPU mirror of the std140 ShaderToyInputs block declared in
+// SHADERTOY_INPUTS_GLSL. Member order and padding must match it exactly.
+struct ShaderToyInputs
+{
+	glm::vec3 iResolution;				// offset 0
+	float iTime;						// offset 12
+	glm::vec4 iMouse;					// offset 16
+	glm::vec4 iDate;					// offset 32
+	float iTimeDelta;					// offset 48
+	float iFrameRate;					// offset 52
+	int iFrame;							// offset 56
+	float iSampleRate;					// offset 60
+	glm::vec4 iChannelTime[4];			// offset 64, float array with 16 byte stride (x used)
+};
+static_assert(sizeof(ShaderToyInputs) == 128, "ShaderToyInputs must match the std140 layout");
+
+#define SHADERTOY_INPUTS_GLSL \
+	"layout(std140) uniform ShaderToyInputs {\n" \
+	"	vec3  iResolution;\n" \
+	"	float iTime;\n" \
+	"	vec4  iMouse;\n" \
+	"	vec4  iDate;\n" \
+	"	float iTimeDelta;\n" \
+	"	float iFrameRate;\n" \
+	"	int   iFrame;\n" \
+	"	float iSampleRate;\n" \
+	"	float iChannelTime[4];\n" \
+	"};\n" \
+	"uniform vec3 iChannelResolution[4];\n" \
+	"vec4 shadertoy_frag_coord();\n"
+
+// Per-pass inputs are plain uniforms rather than block members: they differ
+// between the passes of a render graph but only change when the graph is
+// reconfigured, and plain uniform values persist in each program.
+// shadertoy_frag_coord() is gl_FragCoord on the virtual canvas. It is defined
+// after the shader's own code, so a redeclaration of gl_FragCoord comes
+// first. Programs built for tiled stills or interleaved rendering (see
+// shadertoy_inputs_preamble()) get the remapping version: iTileOffset shifts
+// the coordinate to the tile's position, and with iInterleave = (N, phase),
+// N > 1, each fragment of a 1/N-wide target stands for every Nth pixel of its
+// row. Every other program gets gl_FragCoord as is.
+#define SHADERTOY_FRAG_COORD_GLSL \
+	"vec4 shadertoy_frag_coord() {\n" \
+	"	return gl_FragCoord;\n" \
+	"}\n"
+
+#define SHADERTOY_CANVAS_UNIFORMS_GLSL \
+	"uniform vec2 iTileOffset;\n" \
+	"uniform vec2 iInterleave;\n"
+
+#define SHADERTOY_CANVAS_FRAG_COORD_GLSL \
+	"vec4 shadertoy_frag_coord() {\n" \
+	"	vec4 c = gl_FragCoord;\n" \
+	"	int n = int(iInterleave.x);\n" \
+	"	if (n > 1)\n" \
+	"		c.x = float(int(c.x) * n + (int(c.y) + int(iInterleave.y)) % n) + 0.5;\n" \
+	"	return c + vec4(iTileOffset, 0.0, 0.0);\n" \
+	"}\n"
+
+static const char* const SHADERTOY_CHANNEL_NAMES[] = {
+	"iChannel0", "iChannel1", "iChannel2", "iChannel3"
+};
+
+// Names declared by the preamble; loose declarations of these are dropped by
+// shadertoy_inputs_preamble() so existing shaders keep compiling.
+static const char* const SHADERTOY_INPUT_NAMES[] = {
+	"iResolution", "iTime", "iMouse", "iDate", "iTimeDelta", "iFrameRate",
+	"iFrame", "iSampleRate", "iChannelTime", "iChannelResolution"
+};
+
+// If line is a "uniform <type> <name>[...];" declaration, return <name>.
+inline std::string declared_uniform_name(const std::string& line)
+{
+	size_t i = line.find_first_not_of(" \t");
+	if (i == std::string::npos || line.compare(i, 8, "uniform ") != 0)
+		return "";
+	i = line.find_first_not_of(" \t", i + 8);		// type
+	i = line.find_first_of(" \t", i);
+	i = line.find_first_not_of(" \t", i);			// name
+	if (i == std::string::npos)
+		return "";
+	size_t end = line.find_first_of(" \t[;", i);
+	if (line.find(';', i) == std::string::npos)
+		return "";
+	return line.substr(i, end == std::string::npos ? std::string::npos : end - i);
+}
+
+inline bool is_loose_shadertoy_uniform(const std::string& line)
+{
+	std::string name = declared_uniform_name(line);
+	for (size_t n = 0; n < sizeof(SHADERTOY_INPUT_NAMES) / sizeof(SHADERTOY_INPUT_NAMES[0]); n++){
+		if (name == SHADERTOY_INPUT_NAMES[n])
+			return true;
+	}
+	return false;
+}
+
+inline bool is_identifier_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// line with every use of gl_FragCoord replaced by shadertoy_frag_coord().
+// Redeclarations ("... in vec4 gl_FragCoord;") are left alone.
+inline std::string remap_frag_coord(const std::string& line)
+{
+	static const char name[] = "gl_FragCoord";
+	const size_t length = sizeof(name) - 1;
+	std::string out;
+	size_t from = 0;
+	for (size_t pos = line.find(name); pos != std::string::npos; pos = line.find(name, pos + length)){
+		if ((pos > 0 && is_identifier_char(line[pos - 1])) ||
+			(pos + length < line.size() && is_identifier_char(line[pos + length])))
+			continue;
+		size_t type_end = pos > 0 ? line.find_last_not_of(" \t", pos - 1) : std::string::npos;
+		if (type_end != std::string::npos && type_end >= 3 && line.compare(type_end - 3, 4, "vec4") == 0)
+			continue;
+		out.append(line, from, pos - from);
+		out += "shadertoy_frag_coord()";
+		from = pos + length;
+	}
+	out.append(line, from, std::string::npos);
+	return out;
+}
+
+// Compatibility preamble: inserts the ShaderToyInputs block right after the
+// #version line and blanks out loose declarations of the built-ins. iChannelN
+// samplers the shader doesn't declare itself are declared as sampler2D. Line
+// numbers in compiler errors are kept pointing at the original file. With
+// remap_canvas, for tiled stills and interleaved rendering, the shader's uses
+// of gl_FragCoord are rewritten to the virtual canvas coordinate.
+inline std::string shadertoy_inputs_preamble(const std::string& source, bool remap_canvas = false)
+{
+	std::string preamble = SHADERTOY_INPUTS_GLSL;
+	if (remap_canvas)
+		preamble += SHADERTOY_CANVAS_UNIFORMS_GLSL;
+	for (int c = 0; c < 4; c++){
+		bool declared = false;
+		for (size_t pos = source.find(SHADERTOY_CHANNEL_NAMES[c]); pos != std::string::npos && !declared;
+			pos = source.find(SHADERTOY_CHANNEL_NAMES[c], pos + 1)){
+			size_t bol = source.rfind('\n', pos);
+			bol = bol == std::string::npos ? 0 : bol + 1;
+			declared = declared_uniform_name(source.substr(bol, source.find('\n', pos) - bol)) == SHADERTOY_CHANNEL_NAMES[c];
+		}
+		if (!declared)
+			preamble += std::string("uniform sampler2D ") + SHADERTOY_CHANNEL_NAMES[c] + ";\n";
+	}
+
+	std::string out;
+	out.reserve(source.size() + 512);
+	bool inserted = false;
+	int line_no = 0;
+	size_t pos = 0;
+	while (pos <= source.size()){
+		size_t eol = source.find('\n', pos);
+		if (eol == std::string::npos)
+			eol = source.size();
+		std::string line = source.substr(pos, eol - pos);
+		line_no++;
+		pos = eol + 1;
+
+		if (is_loose_shadertoy_uniform(line)){
+			out += "\n";
+			continue;
+		}
+		out += remap_canvas ? remap_frag_coord(line) : line;
+		out += "\n";
+		if (!inserted && line.find("#version") != std::string::npos){
+			char directive[32];
+			sprintf(directive, "#line %d\n", line_no + 1);
+			out += preamble;
+			out += directive;
+			inserted = true;
+		}
+	}
+	if (!inserted)
+		out = preamble + "#line 1\n" + out;
+	out += remap_canvas ? SHADERTOY_CANVAS_FRAG_COORD_GLSL : SHADERTOY_FRAG_COORD_GLSL;
+	return out;
+}
+
+// Fills ShaderToyInputs once per frame into a persistently mapped buffer of
+// RING_SIZE slots. A slot is only rewritten after the fence of the frame that
+// last read it has signaled, and the current slot is bound by range.
+class ShaderToyInputsRing
+{
+public:
+	enum { RING_SIZE = 3 };
+
+	ShaderToyInputsRing()
+	{
+		for (int i = 0; i < RING_SIZE; i++)
+			_fences[i] = 0;
+	}
+
+	~ShaderToyInputsRing()
+	{
+		destory();
+	}
+
+	void init()
+	{
+		GLint align = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+		_stride = ((GLsizeiptr)sizeof(ShaderToyInputs) + align - 1) / align * align;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+		glBufferStorage(GL_UNIFORM_BUFFER, _stride * RING_SIZE, NULL, flags);
+		_mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, _stride * RING_SIZE, flags);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		if (_mapped == NULL)
+			printf("Failed to map the ShaderToyInputs ring buffer\n");
+	}
+
+	void destory()
+	{
+		for (int i = 0; i < RING_SIZE; i++){
+			if (_fences[i]) glDeleteSync(_fences[i]);
+			_fences[i] = 0;
+		}
+		if (_buffer){
+			glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glDeleteBuffers(1, &_buffer);
+		}
+		_buffer = 0;
+		_mapped = NULL;
+	}
+
+	// Copy this frame's inputs into the next free slot and bind it. Call once
+	// per frame before any pass draws.
+	void upload(const ShaderToyInputs& inputs)
+	{
+		if (_mapped == NULL)
+			return;
+		_slot = (_slot + 1) % RING_SIZE;
+		_WaitFence(_slot);
+		memcpy(_mapped + _stride * _slot, &inputs, sizeof(ShaderToyInputs));
+		glBindBufferRange(GL_UNIFORM_BUFFER, SHADERTOY_INPUTS_BINDING, _buffer, _stride * _slot, sizeof(ShaderToyInputs));
+	}
+
+	// Fence the current slot. Call once per frame after the last draw that
+	// reads it.
+	void end_frame()
+	{
+		if (_mapped == NULL)
+			return;
+		_fences[_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+private:
+	void _WaitFence(int slot)
+	{
+		if (!_fences[slot])
+			return;
+		GLenum r = glClientWaitSync(_fences[slot], 0, 0);
+		while (r == GL_TIMEOUT_EXPIRED)
+			r = glClientWaitSync(_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(_fences[slot]);
+		_fences[slot] = 0;
+	}
+
+	GLuint _buffer = 0;
+	GLsizeiptr _stride = 0;
+	char* _mapped = NULL;
+	int _slot = RING_SIZE - 1;
+	GLsync _fences[RING_SIZE];
+};
+
+#endif
@@ -0,0 +1,676 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <gli/gli.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "Hash.h"
+#include "FileUtil.h"
+#include "MappedFile.h"
+#include "TextureStreamer.h"
+
+// How a channel samples its texture, as in ShaderToy's channel settings.
+// Part of the cache key: the same image with other settings is another
+// texture.
+struct TextureSettings
+{
+	enum Filter { FILTER_MIPMAP, FILTER_LINEAR, FILTER_NEAREST };
+
+	Filter filter = FILTER_MIPMAP;
+	bool repeat = true;			// otherwise clamp to edge
+	bool vflip = true;			// first image row at the top, as ShaderToy shows it
+	bool srgb = false;			// decode 8-bit images as sRGB
+	bool dxt = false;			// compress 8-bit images to DXT1/DXT5 on load
+	ResampleFilter mip_filter = RESAMPLE_BOX;	// for mip chains built on the CPU
+
+	unsigned int bits() const
+	{
+		return (unsigned int)filter | (repeat ? 4 : 0) | (vflip ? 8 : 0) | (srgb ? 16 : 0) | (dxt ? 32 : 0) | ((unsigned int)mip_filter << 6);
+	}
+
+	// Apply a "nearest", "linear", "mipmap", "clamp", "repeat", "flip",
+	// "noflip", "srgb", "linearspace", "dxt", "uncompressed", "box", "kaiser"
+	// or "lanczos" option; false if unknown.
+	bool parse(const std::string& option)
+	{
+		if (option == "nearest") filter = FILTER_NEAREST;
+		else if (option == "linear") filter = FILTER_LINEAR;
+		else if (option == "mipmap") filter = FILTER_MIPMAP;
+		else if (option == "clamp") repeat = false;
+		else if (option == "repeat") repeat = true;
+		else if (option == "flip") vflip = true;
+		else if (option == "noflip") vflip = false;
+		else if (option == "srgb") srgb = true;
+		else if (option == "linearspace") srgb = false;
+		else if (option == "dxt") dxt = true;
+		else if (option == "uncompressed") dxt = false;
+		else if (option == "box") mip_filter = RESAMPLE_BOX;
+		else if (option == "kaiser") mip_filter = RESAMPLE_KAISER;
+		else if (option == "lanczos") mip_filter = RESAMPLE_LANCZOS;
+		else return false;
+		return true;
+	}
+};
+
+struct TextureCacheStats
+{
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	unsigned int failed = 0;
+	unsigned int textures = 0;		// resident now
+	size_t resident_bytes = 0;
+	size_t peak_bytes = 0;			// most ever resident at once
+	double load_ms = 0.0;			// decode and upload of the misses loaded in place
+};
+
+// GL textures for iChannel inputs, shared by every pass and shader that uses
+// the same image with the same settings. Entries are found by path, size and
+// modification time, then by a hash of the file's contents plus
+// TextureSettings::bits(), so a copy of an image under another name is a hit
+// too. PNG, JPG, TGA, BMP and HDR files decode through
+// SOIL's stb_image (HDR to 32-bit float); DDS and KTX (version 1) are parsed
+// in place and uploaded straight from the mapped file, keeping their own mip
+// levels, with gli as the fallback for DDS layouts not handled directly.
+// Only 2D textures are supported. acquire() and release() count references;
+// the texture is deleted with the last one. Call on the GL thread. With the
+// dxt setting, decoded images are compressed on the CPU by DxtCompressor,
+// mipmaps included, since GL can not generate mipmaps of compressed textures.
+// Those and the chains of the Kaiser and Lanczos mip filters are built by
+// Resampler; otherwise glGenerateTextureMipmap builds them.
+//
+// With streaming enabled, decoded formats load through a TextureStreamer
+// instead: acquire() returns at once with a texture name that the passes
+// leave unbound (it samples as black) until update(), once per frame, has
+// storage for it and uploads a bounded slice of whatever the workers have
+// decoded, smallest mip levels first. Such an entry is keyed by the file's
+// path, size and modification time, since acquire() does not read the file;
+// the decode worker hashes it, and a copy of an image already streamed
+// shares its storage. DDS and KTX need no decoding and still load in place.
+class TextureCache
+{
+public:
+	static TextureCache& instance()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	// Stream decoded formats from now on, uploading up to budget bytes per
+	// update(); threads == 0 picks one decoder per hardware thread.
+	void enable_streaming(size_t budget = TextureStreamer::DEFAULT_BUDGET, unsigned int threads = 0)
+	{
+		_streamer.reset(new TextureStreamer(threads, budget));
+	}
+
+	// Stop streaming, e.g. before the GL context goes away. Textures not
+	// decoded yet stay empty.
+	void disable_streaming()
+	{
+		for (size_t i = 0; i < _entries.size(); i++)
+			if (_entries[i].stream && !_entries[i].stream->done)
+				_entries[i].stream->cancelled = true;
+		_streamer.reset();
+		for (size_t i = 0; i < _entries.size(); i++)
+			if (_entries[i].stream && !_entries[i].stream->done)
+				_entries[i].stream.reset();
+	}
+
+	// Move streamed textures along; call once per frame on the GL thread.
+	void update()
+	{
+		if (!_streamer)
+			return;
+		_streamer->update();
+		for (size_t i = 0; i < _entries.size(); i++){
+			Entry& entry = _entries[i];
+			if (!entry.stream || entry.ready)
+				continue;
+			if (entry.stream->failed){
+				_stats.failed++;
+				entry.stream.reset();
+				continue;
+			}
+			if (entry.stream->levels == 0)
+				continue;
+			entry.key = entry.stream->key;
+			entry.levels = entry.stream->levels;
+			entry.resolution = entry.stream->resolution;
+			entry.bytes = entry.stream->bytes;
+			entry.ready = true;
+			_ApplySampler(entry.texture, entry.settings, entry.levels);
+			_stats.resident_bytes += entry.bytes;
+			_stats.peak_bytes = std::max(_stats.peak_bytes, _stats.resident_bytes);
+		}
+	}
+
+	// Block until every streamed texture is complete.
+	void finish()
+	{
+		if (!_streamer)
+			return;
+		_streamer->finish();
+		update();
+	}
+
+	// Texture for path with settings, 0 if it could not be loaded. resolution,
+	// if given, receives the iChannelResolution value (width, height, 1); it is
+	// 0 while a streamed texture decodes, see resolution().
+	GLuint acquire(const std::string& path, const TextureSettings& settings, glm::vec3* resolution = NULL)
+	{
+		FileStamp stamp;
+		if (!file_stamp(path, stamp) || stamp.size == 0){
+			printf("Impossible to open texture %s\n", path.c_str());
+			_stats.failed++;
+			return 0;
+		}
+		for (size_t i = 0; i < _entries.size(); i++){
+			if (_entries[i].path == path && _entries[i].stamp == stamp && _entries[i].settings.bits() == settings.bits())
+				return _Hit(_entries[i], resolution);
+		}
+
+		Entry entry;
+		entry.path = path;
+		entry.stamp = stamp;
+		entry.settings = settings;
+		entry.refs = 1;
+		if (_streamer && !_HasExtension(path, ".dds") && !_HasExtension(path, ".ktx")){
+			// a name only; the streamer creates the texture with its storage
+			glGenTextures(1, &entry.texture);
+			entry.ready = false;
+			entry.stream = std::make_shared<StreamedTexture>();
+			entry.stream->texture = entry.texture;
+			_streamer->load(entry.stream, path, settings.vflip, settings.filter == TextureSettings::FILTER_MIPMAP, settings.srgb, _Dxt(settings),
+				settings.mip_filter, settings.bits());
+			_stats.misses++;
+			_stats.textures++;
+			_entries.push_back(entry);
+			if (resolution)
+				*resolution = glm::vec3(0.0f);
+			return entry.texture;
+		}
+
+		MappedFile file;
+		if (!file.open(path)){
+			printf("Impossible to open texture %s\n", path.c_str());
+			_stats.failed++;
+			return 0;
+		}
+		hash64_t key = hash_wide(file.data(), file.size(), settings.bits());
+		// the hash read every page; loaders touch them again as they go
+		file.release(0, file.size());
+		for (size_t i = 0; i < _entries.size(); i++){
+			if (_entries[i].key == key)
+				return _Hit(_entries[i], resolution);
+		}
+		entry.key = key;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		const unsigned char* data = (const unsigned char*)file.data();
+		bool ok;
+		if (_HasExtension(path, ".dds"))
+			ok = _LoadDDS(file, settings, entry);
+		else if (_HasExtension(path, ".ktx"))
+			ok = _LoadKTX(file, entry);
+		else
+			ok = _LoadImage(data, file.size(), settings, entry);
+		if (!ok){
+			printf("Can not load texture %s\n", path.c_str());
+			if (entry.texture)
+				glDeleteTextures(1, &entry.texture);
+			_stats.failed++;
+			return 0;
+		}
+		_ApplySampler(entry.texture, settings, entry.levels);
+		_stats.load_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		_stats.misses++;
+		_stats.textures++;
+		_stats.resident_bytes += entry.bytes;
+		_stats.peak_bytes = std::max(_stats.peak_bytes, _stats.resident_bytes);
+		_entries.push_back(entry);
+		if (resolution)
+			*resolution = entry.resolution;
+		return entry.texture;
+	}
+
+	// Drop one reference taken by acquire().
+	void release(GLuint texture)
+	{
+		for (size_t i = 0; i < _entries.size(); i++){
+			if (_entries[i].texture != texture)
+				continue;
+			if (--_entries[i].refs == 0){
+				std::shared_ptr<StreamedTexture> stream = _entries[i].stream;
+				if (stream)
+					stream->cancelled = true;
+				// a worker may still create it; the streamer deletes it after
+				if (stream && !stream->done && _streamer)
+					stream->released = true;
+				else
+					glDeleteTextures(1, &_entries[i].texture);
+				_stats.textures--;
+				_stats.resident_bytes -= _entries[i].bytes;
+				_entries.erase(_entries.begin() + i);
+			}
+			return;
+		}
+	}
+
+	// iChannelResolution of texture; false until a streamed one is decoded.
+	bool resolution(GLuint texture, glm::vec3& resolution) const
+	{
+		for (size_t i = 0; i < _entries.size(); i++){
+			if (_entries[i].texture == texture){
+				resolution = _entries[i].resolution;
+				return _entries[i].ready;
+			}
+		}
+		return false;
+	}
+
+	const TextureStreamer* streamer() const
+	{
+		return _streamer.get();
+	}
+
+	const TextureCacheStats& stats() const
+	{
+		return _stats;
+	}
+
+	void print_stats() const
+	{
+		unsigned int lookups = _stats.hits + _stats.misses;
+		printf("texture cache: %u hits, %u misses (%.0f%% hit rate), %u failed, %u textures resident in %.2f MB (peak %.2f MB), %.1f ms loading\n",
+			_stats.hits, _stats.misses, lookups > 0 ? 100.0 * _stats.hits / lookups : 0.0, _stats.failed,
+			_stats.textures, _stats.resident_bytes / (1024.0 * 1024.0), _stats.peak_bytes / (1024.0 * 1024.0), _stats.load_ms);
+		if (_streamer)
+			_streamer->print_stats();
+	}
+
+private:
+	struct Entry
+	{
+		hash64_t key = 0;				// 0 while a streamed texture decodes
+		std::string path;
+		FileStamp stamp;
+		GLuint texture = 0;
+		GLsizei levels = 1;
+		glm::vec3 resolution;
+		size_t bytes = 0;				// 0 for a view of another entry's storage
+		bool ready = true;				// false while a streamed texture has no storage
+		unsigned int refs = 0;
+		TextureSettings settings;
+		std::shared_ptr<StreamedTexture> stream;
+	};
+
+	TextureCache() {}
+
+	GLuint _Hit(Entry& entry, glm::vec3* resolution)
+	{
+		entry.refs++;
+		_stats.hits++;
+		if (resolution)
+			*resolution = entry.ready ? entry.resolution : glm::vec3(0.0f);
+		return entry.texture;
+	}
+
+	static bool _HasExtension(const std::string& path, const char* ext)
+	{
+		size_t n = strlen(ext);
+		if (path.size() < n)
+			return false;
+		std::string tail = path.substr(path.size() - n);
+		std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+		return tail == ext;
+	}
+
+	static GLsizei _MipCount(int width, int height)
+	{
+		GLsizei levels = 1;
+		while ((width | height) >> levels)
+			levels++;
+		return levels;
+	}
+
+	// DXT needs EXT_texture_compression_s3tc; without it the setting is ignored.
+	static bool _Dxt(const TextureSettings& settings)
+	{
+		return settings.dxt && GLEW_EXT_texture_compression_s3tc;
+	}
+
+	// Decoded images: 8-bit RGBA, or RGBA32F for HDR. Mipmaps are generated,
+	// on the CPU when the levels are compressed or filtered other than by box.
+	bool _LoadImage(const unsigned char* data, size_t size, const TextureSettings& settings, Entry& entry)
+	{
+		DecodedImage image;
+		if (!decode_image(data, size, settings.vflip, image))
+			return false;
+		bool mipmaps = settings.filter == TextureSettings::FILTER_MIPMAP;
+		bool dxt = _Dxt(settings) && !image.hdr;
+		if (mipmaps && (dxt || settings.mip_filter != RESAMPLE_BOX))
+			generate_mips(image, settings.mip_filter, settings.srgb);
+		if (dxt)
+			compress_image(image);
+		entry.levels = mipmaps ? _MipCount(image.width, image.height) : 1;
+		GLenum format = image_format(image, settings.srgb);
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, entry.levels, format, image.width, image.height);
+		for (GLsizei level = 0; level < image.levels(); level++){
+			const unsigned char* pixels = &image.pixels[image.level_offsets[level]];
+			if (image.block_size)
+				glCompressedTextureSubImage2D(entry.texture, level, 0, 0, image.level_width(level), image.level_height(level),
+					format, (GLsizei)image.level_bytes(level), pixels);
+			else
+				glTextureSubImage2D(entry.texture, level, 0, 0, image.level_width(level), image.level_height(level), GL_RGBA,
+					image.hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, pixels);
+		}
+		entry.bytes = image.pixels.size();
+		if (image.levels() < entry.levels){
+			glGenerateTextureMipmap(entry.texture);
+			entry.bytes = entry.bytes * 4 / 3;
+		}
+		entry.resolution = glm::vec3(image.width, image.height, 1.0f);
+		return true;
+	}
+
+	// GL format of a DDS pixel format. block_size is the bytes per 4x4 block
+	// of compressed formats, pixel_size the bytes per pixel of the others.
+	struct DDSFormat
+	{
+		GLenum internal_format, format, type;
+		unsigned int block_size, pixel_size;
+	};
+
+	static DDSFormat _Compressed(GLenum internal_format, unsigned int block_size)
+	{
+		DDSFormat f;
+		f.internal_format = internal_format;
+		f.format = f.type = 0;
+		f.block_size = block_size;
+		f.pixel_size = 0;
+		return f;
+	}
+
+	static DDSFormat _Uncompressed(GLenum internal_format, GLenum format, GLenum type, unsigned int pixel_size)
+	{
+		DDSFormat f;
+		f.internal_format = internal_format;
+		f.format = format;
+		f.type = type;
+		f.block_size = 0;
+		f.pixel_size = pixel_size;
+		return f;
+	}
+
+	// The formats an iChannel is likely to come in: S3TC, RGTC and BPTC,
+	// 8-bit RGB(A)/BGR(A), and 16/32-bit float. false for anything else,
+	// which is left to gli.
+	static bool _DDSFormatOf(const unsigned char* header, DDSFormat& out)
+	{
+		enum { DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40 };
+		unsigned int pf_flags, fourcc, bit_count, masks[4];
+		memcpy(&pf_flags, header + 80, 4);
+		memcpy(&fourcc, header + 84, 4);
+		memcpy(&bit_count, header + 88, 4);
+		memcpy(masks, header + 92, 16);
+#define DDS_FOURCC(a, b, c, d) ((unsigned int)(a) | (unsigned int)(b) << 8 | (unsigned int)(c) << 16 | (unsigned int)(d) << 24)
+		if (pf_flags & DDPF_FOURCC){
+			switch (fourcc){
+			case DDS_FOURCC('D', 'X', 'T', '1'):
+				out = _Compressed(pf_flags & DDPF_ALPHAPIXELS ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8);
+				return true;
+			case DDS_FOURCC('D', 'X', 'T', '3'): out = _Compressed(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16); return true;
+			case DDS_FOURCC('D', 'X', 'T', '5'): out = _Compressed(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16); return true;
+			case DDS_FOURCC('A', 'T', 'I', '1'):
+			case DDS_FOURCC('B', 'C', '4', 'U'): out = _Compressed(GL_COMPRESSED_RED_RGTC1, 8); return true;
+			case DDS_FOURCC('B', 'C', '4', 'S'): out = _Compressed(GL_COMPRESSED_SIGNED_RED_RGTC1, 8); return true;
+			case DDS_FOURCC('A', 'T', 'I', '2'):
+			case DDS_FOURCC('B', 'C', '5', 'U'): out = _Compressed(GL_COMPRESSED_RG_RGTC2, 16); return true;
+			case DDS_FOURCC('B', 'C', '5', 'S'): out = _Compressed(GL_COMPRESSED_SIGNED_RG_RGTC2, 16); return true;
+			case 36: out = _Uncompressed(GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8); return true;
+			case 113: out = _Uncompressed(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8); return true;
+			case 116: out = _Uncompressed(GL_RGBA32F, GL_RGBA, GL_FLOAT, 16); return true;
+			case DDS_FOURCC('D', 'X', '1', '0'): break;
+			default: return false;
+			}
+			unsigned int dxgi;
+			memcpy(&dxgi, header + 128, 4);
+			switch (dxgi){
+			case 2: out = _Uncompressed(GL_RGBA32F, GL_RGBA, GL_FLOAT, 16); return true;
+			case 10: out = _Uncompressed(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8); return true;
+			case 11: out = _Uncompressed(GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8); return true;
+			case 16: out = _Uncompressed(GL_RG32F, GL_RG, GL_FLOAT, 8); return true;
+			case 24: out = _Uncompressed(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 4); return true;
+			case 26: out = _Uncompressed(GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 4); return true;
+			case 28: out = _Uncompressed(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4); return true;
+			case 29: out = _Uncompressed(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4); return true;
+			case 34: out = _Uncompressed(GL_RG16F, GL_RG, GL_HALF_FLOAT, 4); return true;
+			case 41: out = _Uncompressed(GL_R32F, GL_RED, GL_FLOAT, 4); return true;
+			case 49: out = _Uncompressed(GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2); return true;
+			case 54: out = _Uncompressed(GL_R16F, GL_RED, GL_HALF_FLOAT, 2); return true;
+			case 61: out = _Uncompressed(GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1); return true;
+			case 71: out = _Compressed(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8); return true;
+			case 72: out = _Compressed(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8); return true;
+			case 74: out = _Compressed(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16); return true;
+			case 75: out = _Compressed(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16); return true;
+			case 77: out = _Compressed(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16); return true;
+			case 78: out = _Compressed(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16); return true;
+			case 80: out = _Compressed(GL_COMPRESSED_RED_RGTC1, 8); return true;
+			case 81: out = _Compressed(GL_COMPRESSED_SIGNED_RED_RGTC1, 8); return true;
+			case 83: out = _Compressed(GL_COMPRESSED_RG_RGTC2, 16); return true;
+			case 84: out = _Compressed(GL_COMPRESSED_SIGNED_RG_RGTC2, 16); return true;
+			case 87: out = _Uncompressed(GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4); return true;
+			case 91: out = _Uncompressed(GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 4); return true;
+			case 95: out = _Compressed(GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16); return true;
+			case 96: out = _Compressed(GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16); return true;
+			case 98: out = _Compressed(GL_COMPRESSED_RGBA_BPTC_UNORM, 16); return true;
+			case 99: out = _Compressed(GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16); return true;
+			default: return false;
+			}
+		}
+#undef DDS_FOURCC
+		if (!(pf_flags & DDPF_RGB))
+			return false;
+		bool alpha = (pf_flags & DDPF_ALPHAPIXELS) && masks[3] == 0xFF000000;
+		if (bit_count == 32 && masks[0] == 0x000000FF && masks[1] == 0x0000FF00 && masks[2] == 0x00FF0000)
+			out = _Uncompressed(alpha ? GL_RGBA8 : GL_RGB8, GL_RGBA, GL_UNSIGNED_BYTE, 4);
+		else if (bit_count == 32 && masks[0] == 0x00FF0000 && masks[1] == 0x0000FF00 && masks[2] == 0x000000FF)
+			out = _Uncompressed(alpha ? GL_RGBA8 : GL_RGB8, GL_BGRA, GL_UNSIGNED_BYTE, 4);
+		else if (bit_count == 24 && masks[0] == 0x000000FF && masks[1] == 0x0000FF00 && masks[2] == 0x00FF0000)
+			out = _Uncompressed(GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 3);
+		else if (bit_count == 24 && masks[0] == 0x00FF0000 && masks[1] == 0x0000FF00 && masks[2] == 0x000000FF)
+			out = _Uncompressed(GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE, 3);
+		else
+			return false;
+		return true;
+	}
+
+	// DDS parsed in place: each level is uploaded straight from the mapped
+	// file, with no copy on the heap, and its pages are released once GL has
+	// them. vflip only applies to uncompressed formats, whose rows are then
+	// uploaded bottom-up; block-compressed data is used as authored. Cube
+	// maps, volumes, arrays and pixel formats not handled here go through
+	// gli.
+	bool _LoadDDS(const MappedFile& file, const TextureSettings& settings, Entry& entry)
+	{
+		enum { DDSD_MIPMAPCOUNT = 0x20000, DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_VOLUME = 0x200000 };
+		const unsigned char* data = (const unsigned char*)file.data();
+		size_t size = file.size();
+		if (size < 128 || memcmp(data, "DDS ", 4) != 0)
+			return false;
+		unsigned int flags, height, width, mip_count, caps2, fourcc;
+		memcpy(&flags, data + 8, 4);
+		memcpy(&height, data + 12, 4);
+		memcpy(&width, data + 16, 4);
+		memcpy(&mip_count, data + 28, 4);
+		memcpy(&fourcc, data + 84, 4);
+		memcpy(&caps2, data + 112, 4);
+		size_t offset = 128;
+		bool array = false;
+		if (fourcc == 0x30315844){ // "DX10"
+			if (size < 148)
+				return false;
+			unsigned int dimension, misc, array_size;
+			memcpy(&dimension, data + 132, 4);
+			memcpy(&misc, data + 136, 4);
+			memcpy(&array_size, data + 140, 4);
+			array = dimension != 3 || (misc & 0x4) || array_size > 1; // TEXTURE2D, TEXTURECUBE
+			offset = 148;
+		}
+		DDSFormat format;
+		if ((caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) || array || !_DDSFormatOf(data, format))
+			return _LoadDDSWithGli(data, size, settings, entry);
+		if (width == 0 || height == 0)
+			return false;
+
+		entry.levels = (flags & DDSD_MIPMAPCOUNT) && mip_count > 0 ? (GLsizei)mip_count : 1;
+		entry.levels = std::min(entry.levels, _MipCount((int)width, (int)height));
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, entry.levels, format.internal_format, (GLsizei)width, (GLsizei)height);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (GLsizei level = 0; level < entry.levels; level++){
+			GLsizei w = std::max(1, (GLsizei)width >> level), h = std::max(1, (GLsizei)height >> level);
+			size_t row_bytes = format.block_size ? (size_t)((w + 3) / 4) * format.block_size : (size_t)w * format.pixel_size;
+			size_t level_bytes = row_bytes * (format.block_size ? (h + 3) / 4 : h);
+			if (offset + level_bytes > size){
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				return false;
+			}
+			if (format.block_size)
+				glCompressedTextureSubImage2D(entry.texture, level, 0, 0, w, h, format.internal_format, (GLsizei)level_bytes,
+					data + offset);
+			else if (settings.vflip){
+				for (GLsizei y = 0; y < h; y++)
+					glTextureSubImage2D(entry.texture, level, 0, h - 1 - y, w, 1, format.format, format.type, data + offset + y * row_bytes);
+			}
+			else
+				glTextureSubImage2D(entry.texture, level, 0, 0, w, h, format.format, format.type, data + offset);
+			file.release(offset, level_bytes);
+			entry.bytes += level_bytes;
+			offset += level_bytes;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		entry.resolution = glm::vec3(width, height, 1.0f);
+		return true;
+	}
+
+	// DDS through gli, which copies the whole file into its own storage
+	// first, uploaded level by level as stored.
+	bool _LoadDDSWithGli(const unsigned char* data, size_t size, const TextureSettings& settings, Entry& entry)
+	{
+		gli::storage storage = gli::load_dds((const char*)data, size);
+		if (storage.empty())
+			return false;
+		if (storage.layers() > 1 || storage.faces() > 1){
+			printf("Only 2D textures can be iChannel inputs\n");
+			return false;
+		}
+		gli::texture2D stored(storage);
+		gli::texture2D texture(settings.vflip && !gli::is_compressed(stored.format()) ? gli::flip(stored) : stored);
+		gli::gl translator;
+		const gli::gl::format& format = translator.translate(texture.format());
+		bool compressed = gli::is_compressed(texture.format());
+		gli::texture2D::dim_type size0 = texture.dimensions();
+
+		entry.levels = (GLsizei)texture.levels();
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, entry.levels, (GLenum)format.Internal, (GLsizei)size0.x, (GLsizei)size0.y);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (GLsizei level = 0; level < entry.levels; level++){
+			gli::image image = texture[level];
+			gli::image::dim_type dim = image.dimensions();
+			if (compressed)
+				glCompressedTextureSubImage2D(entry.texture, level, 0, 0, (GLsizei)dim.x, (GLsizei)dim.y,
+					(GLenum)format.Internal, (GLsizei)image.size(), image.data());
+			else
+				glTextureSubImage2D(entry.texture, level, 0, 0, (GLsizei)dim.x, (GLsizei)dim.y,
+					(GLenum)format.External, (GLenum)format.Type, image.data());
+			entry.bytes += image.size();
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		entry.resolution = glm::vec3(size0.x, size0.y, 1.0f);
+		return true;
+	}
+
+	// KTX 1: a 64-byte header of GL enums, key/value data, then per level a
+	// 32-bit size and the data padded to 4 bytes. Little-endian files only.
+	// Rows are already in GL's bottom-up order, so vflip does not apply.
+	// Levels are uploaded straight from the mapped file, like DDS.
+	bool _LoadKTX(const MappedFile& file, Entry& entry)
+	{
+		const unsigned char* data = (const unsigned char*)file.data();
+		size_t size = file.size();
+		static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+		if (size < 64 || memcmp(data, identifier, 12) != 0)
+			return false;
+		unsigned int header[13];
+		memcpy(header, data + 12, sizeof(header));
+		if (header[0] != 0x04030201){
+			printf("Big-endian KTX files are not supported\n");
+			return false;
+		}
+		GLenum type = header[1], format = header[3], internal_format = header[4];
+		GLsizei width = (GLsizei)header[6], height = (GLsizei)header[7];
+		if (header[8] > 1 || header[9] > 0 || header[10] > 1 || height == 0){
+			printf("Only 2D textures can be iChannel inputs\n");
+			return false;
+		}
+		if (width <= 0 || height < 0)
+			return false;
+		entry.levels = header[11] > 0 ? (GLsizei)std::min(header[11], 32u) : 1;
+		entry.levels = std::min(entry.levels, _MipCount(width, height));
+		size_t offset = 64 + header[12];
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, entry.levels, internal_format, width, height);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (GLsizei level = 0; level < entry.levels; level++){
+			if (offset + 4 > size)
+				return false;
+			unsigned int image_size;
+			memcpy(&image_size, data + offset, 4);
+			offset += 4;
+			if (offset + image_size > size)
+				return false;
+			GLsizei w = std::max(1, width >> level), h = std::max(1, height >> level);
+			if (type == 0)
+				glCompressedTextureSubImage2D(entry.texture, level, 0, 0, w, h, internal_format, (GLsizei)image_size, data + offset);
+			else
+				glTextureSubImage2D(entry.texture, level, 0, 0, w, h, format, type, data + offset);
+			file.release(offset, image_size);
+			entry.bytes += image_size;
+			offset += (image_size + 3) & ~3u;
+		}
+		entry.resolution = glm::vec3(width, height, 1.0f);
+		return true;
+	}
+
+	// Containers without mip levels are sampled without mipmaps even under
+	// FILTER_MIPMAP.
+	void _ApplySampler(GLuint texture, const TextureSettings& settings, GLsizei levels)
+	{
+		GLenum mag = settings.filter == TextureSettings::FILTER_NEAREST ? GL_NEAREST : GL_LINEAR;
+		GLenum min = mag;
+		if (settings.filter == TextureSettings::FILTER_MIPMAP && levels > 1)
+			min = GL_LINEAR_MIPMAP_LINEAR;
+		GLenum wrap = settings.repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, min);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, mag);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, wrap);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, wrap);
+		glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+
+	std::vector<Entry> _entries;
+	std::unique_ptr<TextureStreamer> _streamer;
+	TextureCacheStats _stats;
+};
+
+#endif
@@ -0,0 +1,664 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <soil/SOIL.h>
+#include <soil/stb_image_aug.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "Hash.h"
+#include "Headless.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "DxtCompressor.h"
+#include "Resampler.h"
+
+// An image decoded to RGBA, 8-bit or 32-bit float for HDR, with its rows in
+// GL's bottom-up order when flipped. pixels holds every level one after the
+// other, level 0 first, at level_offsets. After compress_image() the levels
+// hold DXT blocks instead, and a row is a row of 4x4 blocks.
+struct DecodedImage
+{
+	int width = 0;
+	int height = 0;
+	bool hdr = false;
+	bool alpha = false;			// the file has an alpha channel
+	int block_size = 0;			// bytes per DXT block once compressed, else 0
+	std::vector<unsigned char> pixels;
+	std::vector<size_t> level_offsets;
+
+	size_t pixel_size() const
+	{
+		return hdr ? 4 * sizeof(float) : 4;
+	}
+
+	GLsizei levels() const
+	{
+		return (GLsizei)level_offsets.size();
+	}
+
+	int level_width(GLsizei level) const
+	{
+		return std::max(1, width >> level);
+	}
+
+	int level_height(GLsizei level) const
+	{
+		return std::max(1, height >> level);
+	}
+
+	// Rows of pixels, or of blocks when compressed.
+	int level_rows(GLsizei level) const
+	{
+		return block_size ? (level_height(level) + 3) / 4 : level_height(level);
+	}
+
+	size_t row_bytes(GLsizei level) const
+	{
+		return block_size ? (size_t)(level_width(level) + 3) / 4 * block_size : (size_t)level_width(level) * pixel_size();
+	}
+
+	size_t level_bytes(GLsizei level) const
+	{
+		return row_bytes(level) * level_rows(level);
+	}
+};
+
+// GL internal format of image's levels.
+inline GLenum image_format(const DecodedImage& image, bool srgb)
+{
+	if (image.hdr)
+		return GL_RGBA32F;
+	if (image.block_size == 8)
+		return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	if (image.block_size == 16)
+		return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+}
+
+// Decode a PNG/JPG/TGA/BMP (through SOIL) or HDR (through stb_image, to
+// float) file image into level 0 of image. vflip puts the first row of the
+// file at the top of the texture, as ShaderToy shows it.
+inline bool decode_image(const unsigned char* data, size_t size, bool vflip, DecodedImage& image)
+{
+	int width = 0, height = 0, channels = 0;
+	image.hdr = stbi_is_hdr_from_memory(data, (int)size) != 0;
+	void* pixels;
+	if (image.hdr)
+		pixels = stbi_loadf_from_memory(data, (int)size, &width, &height, &channels, 4);
+	else
+		pixels = SOIL_load_image_from_memory(data, (int)size, &width, &height, &channels, SOIL_LOAD_RGBA);
+	if (pixels == NULL)
+		return false;
+	image.width = width;
+	image.height = height;
+	image.alpha = channels == 2 || channels == 4;
+	image.block_size = 0;
+	size_t row = (size_t)width * image.pixel_size();
+	image.pixels.resize(row * height);
+	const unsigned char* rows = (const unsigned char*)pixels;
+	for (int y = 0; y < height; y++)
+		memcpy(&image.pixels[y * row], rows + (vflip ? height - 1 - y : y) * row, row);
+	image.level_offsets.assign(1, 0);
+	if (image.hdr)
+		stbi_image_free(pixels);
+	else
+		SOIL_free_image_data((unsigned char*)pixels);
+	return true;
+}
+
+// Append the full mip chain below level 0, each level reduced from the one
+// above by Resampler with filter; with the box filter, odd edges repeat
+// their last texel. srgb filters 8-bit colors in linear light, as GL does
+// when it generates mipmaps of an sRGB texture.
+inline void generate_mips(DecodedImage& image, ResampleFilter filter = RESAMPLE_BOX, bool srgb = false)
+{
+	GLsizei levels = 1;
+	while ((image.width | image.height) >> levels)
+		levels++;
+	image.level_offsets.resize(1);
+	size_t total = image.level_bytes(0);
+	for (GLsizei level = 1; level < levels; level++){
+		image.level_offsets.push_back(total);
+		total += image.level_bytes(level);
+	}
+	image.pixels.resize(total);
+	for (GLsizei level = 1; level < levels; level++)
+		Resampler::instance().reduce(&image.pixels[image.level_offsets[level - 1]], image.level_width(level - 1), image.level_height(level - 1),
+			image.hdr, &image.pixels[image.level_offsets[level]], filter, srgb);
+}
+
+// Compress every level to DXT5 if the file has alpha, DXT1 otherwise, with
+// the same output as SOIL's SOIL_FLAG_COMPRESS_TO_DXT. A quarter (DXT5) or
+// an eighth (DXT1) of the memory, at some loss of quality. HDR images stay
+// as they are.
+inline void compress_image(DecodedImage& image)
+{
+	if (image.hdr || image.block_size)
+		return;
+	DxtFormat format = image.alpha ? DXT5 : DXT1;
+	std::vector<unsigned char> pixels;
+	pixels.swap(image.pixels);
+	std::vector<size_t> offsets = image.level_offsets;
+	image.block_size = format == DXT1 ? 8 : 16;
+	size_t total = 0;
+	for (GLsizei level = 0; level < image.levels(); level++){
+		image.level_offsets[level] = total;
+		total += image.level_bytes(level);
+	}
+	image.pixels.resize(total);
+	for (GLsizei level = 0; level < image.levels(); level++)
+		DxtCompressor::instance().compress(&pixels[offsets[level]], image.level_width(level), image.level_height(level), 4,
+			format, &image.pixels[image.level_offsets[level]]);
+}
+
+// A texture filled in by TextureStreamer. texture is a name from
+// glGenTextures: the texture itself is only created with its storage, once
+// the image is decoded, so it must not be bound before levels is set. From
+// then on base_level is the finest level uploaded, and the texture samples
+// only the levels from there down, so it shows a blurry version until done.
+// Every field is only touched on the GL thread.
+struct StreamedTexture
+{
+	GLuint texture = 0;
+	hash64_t key = 0;						// hash of the file's contents once decoded
+	glm::vec3 resolution = glm::vec3(0.0f);	// (width, height, 1) once decoded
+	GLsizei levels = 0;						// 0 until the storage exists
+	GLsizei base_level = 0;
+	size_t bytes = 0;						// GPU bytes; 0 for a view
+	bool view = false;						// shares the storage of a copy of the same image
+	bool done = false;
+	bool failed = false;
+	bool cancelled = false;					// stop uploading
+	bool released = false;					// the owner let go; the streamer deletes texture
+};
+
+struct TextureStreamerStats
+{
+	unsigned int requested = 0;
+	unsigned int completed = 0;
+	unsigned int failed = 0;
+	unsigned int cancelled = 0;
+	unsigned int views = 0;			// copies of an image already loaded, not uploaded again
+	size_t uploaded_bytes = 0;
+	unsigned int updates = 0;		// update() calls that uploaded anything
+	double decode_ms = 0.0;			// file read, decode, mips and compression, summed over the workers
+	double update_ms = 0.0;			// on the GL thread
+	double max_update_ms = 0.0;
+};
+
+// Loads images without stalling the GL thread. Workers read, hash, decode
+// and build the mip chain on a ThreadPool, like AssetLoader. Allocating the
+// storage costs time in proportion to the texture, tens of milliseconds for
+// a 4K chain under llvmpipe, so it runs on one more thread with a
+// SharedContext, and update() polls its fence; without a shared context it
+// falls back to update(), one texture per call. The GL thread calls
+// update() once per frame, which copies at most budget bytes into one slot
+// of a persistently mapped pixel unpack buffer ring and uploads from there,
+// so a large image arrives over several frames instead of in one long one.
+// The smallest pending level of any texture goes first, so every texture
+// gets a blurry preview within a frame of its storage and sharpens as the
+// larger levels follow; levels bigger than the budget are split into bands
+// of rows. Slots are fenced as in ShaderToyInputsRing. A file whose contents
+// hash like a texture already streamed becomes a view of that texture's
+// storage instead. Construct, update and destroy on the GL thread.
+class TextureStreamer
+{
+public:
+	enum { RING_SIZE = 3, DEFAULT_BUDGET = 1 << 20 };
+
+	// threads == 0 picks one per hardware thread.
+	explicit TextureStreamer(unsigned int threads = 0, size_t budget = DEFAULT_BUDGET)
+	{
+		for (int i = 0; i < RING_SIZE; i++)
+			_fences[i] = 0;
+		// a slot holds at least one row of the widest float texture
+		GLint max_size = 16384;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		_budget = std::max(budget, (size_t)max_size * 4 * sizeof(float));
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &_buffer);
+		glNamedBufferStorage(_buffer, (GLsizeiptr)(_budget * RING_SIZE), NULL, flags);
+		_mapped = (unsigned char*)glMapNamedBufferRange(_buffer, 0, (GLsizeiptr)(_budget * RING_SIZE), flags);
+		if (_mapped == NULL)
+			printf("Failed to map the texture upload buffer\n");
+		_pool.reset(new ThreadPool(threads, (size_t)-1, true));
+		if (_context.init()){
+			std::atomic<bool> current{ false };
+			_allocator.reset(new ThreadPool(1, (size_t)-1, true));
+			_allocator->submit([this, &current]{ current = _context.make_current(); });
+			_allocator->wait_idle();
+			if (!current)
+				_allocator.reset();
+		}
+	}
+
+	~TextureStreamer()
+	{
+		_cancel = true;
+		_pool.reset();
+		if (_allocator){
+			_allocator->submit([this]{ _context.release_current(); });
+			_allocator.reset();
+		}
+		_context.destory();
+		for (size_t i = 0; i < _decoded.size(); i++)
+			_Drop(*_decoded[i]);
+		for (size_t i = 0; i < _waiting.size(); i++)
+			_Drop(*_waiting[i]);
+		for (size_t i = 0; i < _allocating.size(); i++)
+			_Drop(*_allocating[i]);
+		for (size_t i = 0; i < _active.size(); i++)
+			_Drop(*_active[i]);
+		for (int i = 0; i < RING_SIZE; i++)
+			if (_fences[i]) glDeleteSync(_fences[i]);
+		if (_buffer){
+			glUnmapNamedBuffer(_buffer);
+			glDeleteBuffers(1, &_buffer);
+		}
+	}
+
+	// Queue path for decoding into target->texture, a name from
+	// glGenTextures. mipmaps builds the whole chain with mip_filter, otherwise
+	// only level 0 is stored; srgb stores 8-bit images as sRGB and dxt
+	// compresses them, see compress_image(). The contents are hashed with
+	// key_seed, which must tell every other setting apart, into target->key.
+	void load(const std::shared_ptr<StreamedTexture>& target, const std::string& path, bool vflip, bool mipmaps, bool srgb, bool dxt = false,
+		ResampleFilter mip_filter = RESAMPLE_BOX, hash64_t key_seed = 0)
+	{
+		_stats.requested++;
+		std::shared_ptr<StreamedTexture> texture = target;
+		_pool->submit([this, texture, path, vflip, mipmaps, srgb, dxt, mip_filter, key_seed]{
+			std::unique_ptr<Job> job(new Job());
+			job->target = texture;
+			job->srgb = srgb;
+			// still handed back, so the GL thread can delete a released texture
+			if (_cancel){
+				std::lock_guard<std::mutex> lock(_mutex);
+				_decoded.push_back(std::move(job));
+				return;
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			MappedFile file;
+			job->ok = file.open(path);
+			if (job->ok)
+				job->key = hash_wide(file.data(), file.size(), key_seed);
+			job->ok = job->ok && decode_image((const unsigned char*)file.data(), file.size(), vflip, job->image);
+			if (job->ok && mipmaps)
+				generate_mips(job->image, mip_filter, srgb);
+			if (job->ok && dxt)
+				compress_image(job->image);
+			if (!job->ok)
+				printf("Can not load texture %s\n", path.c_str());
+			job->decode_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::lock_guard<std::mutex> lock(_mutex);
+			_decoded.push_back(std::move(job));
+		});
+	}
+
+	// Upload up to budget bytes of whatever has been decoded. Call once per
+	// frame on the GL thread; returns the bytes uploaded.
+	size_t update()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		_Collect();
+		if (_active.empty() || _mapped == NULL)
+			return 0;
+		_slot = (_slot + 1) % RING_SIZE;
+		_WaitFence(_slot);
+		size_t slot_offset = _budget * _slot;
+		size_t used = 0;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		while (used < _budget){
+			Job* job = _Next();
+			if (job == NULL)
+				break;
+			const DecodedImage& image = job->image;
+			GLsizei level = job->level;
+			int width = image.level_width(level), height = image.level_height(level);
+			size_t row_bytes = image.row_bytes(level);
+			int rows = std::min(image.level_rows(level) - job->row, (int)((_budget - used) / row_bytes));
+			if (rows == 0)
+				break;
+			memcpy(_mapped + slot_offset + used, &image.pixels[image.level_offsets[level] + job->row * row_bytes], rows * row_bytes);
+			if (image.block_size){
+				// bands of whole block rows; only the last may be short of 4 pixel rows
+				int y = job->row * 4;
+				glCompressedTextureSubImage2D(job->target->texture, level, 0, y, width, std::min(rows * 4, height - y),
+					image_format(image, job->srgb), (GLsizei)(rows * row_bytes), (const void*)(slot_offset + used));
+			}
+			else
+				glTextureSubImage2D(job->target->texture, level, 0, job->row, width, rows, GL_RGBA,
+					image.hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, (const void*)(slot_offset + used));
+			used += rows * row_bytes;
+			job->row += rows;
+			if (job->row == image.level_rows(level))
+				_FinishLevel(*job);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		_fences[_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		_active.erase(std::remove_if(_active.begin(), _active.end(),
+			[](const std::unique_ptr<Job>& job){ return job->target->done || job->target->cancelled; }), _active.end());
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		_stats.uploaded_bytes += used;
+		_stats.update_ms += ms;
+		_stats.max_update_ms = std::max(_stats.max_update_ms, ms);
+		_stats.updates++;
+		return used;
+	}
+
+	// Textures queued, decoding or uploading.
+	unsigned int pending() const
+	{
+		return _stats.requested - _stats.completed - _stats.failed - _stats.cancelled;
+	}
+
+	// Upload everything queued so far, blocking until it is done.
+	void finish()
+	{
+		while (pending() > 0)
+			if (update() == 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	size_t budget() const
+	{
+		return _budget;
+	}
+
+	const TextureStreamerStats& stats() const
+	{
+		return _stats;
+	}
+
+	void print_stats() const
+	{
+		if (_stats.requested == 0)
+			return;
+		printf("texture streaming: %u loaded (%u shared), %u failed, %.1f MB in %u frames (%.2f MB budget), %.1f ms decode on %u threads, upload %.2f ms per frame (max %.2f ms)\n",
+			_stats.completed, _stats.views, _stats.failed, _stats.uploaded_bytes / (1024.0 * 1024.0), _stats.updates,
+			_budget / (1024.0 * 1024.0), _stats.decode_ms, (unsigned int)_pool->size(),
+			_stats.updates > 0 ? _stats.update_ms / _stats.updates : 0.0, _stats.max_update_ms);
+	}
+
+private:
+	struct Job
+	{
+		std::shared_ptr<StreamedTexture> target;
+		DecodedImage image;
+		hash64_t key = 0;
+		bool srgb = false;
+		bool ok = false;
+		double decode_ms = 0.0;
+		std::atomic<GLsync> allocated{ NULL };	// set by the allocator thread
+		GLsizei level = 0;			// next level to upload, counting down
+		int row = 0;				// next row of that level
+	};
+
+	// Move decoded images on. A copy of a texture already complete becomes a
+	// view of its storage, a copy of one still on its way waits for it, and
+	// any other image gets its storage. In place, without the allocator
+	// thread, only one texture is allocated per update().
+	void _Collect()
+	{
+		for (size_t i = 0; i < _allocating.size();){
+			Job& job = *_allocating[i];
+			GLsync fence = job.allocated;
+			if (fence == NULL || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED){
+				i++;
+				continue;
+			}
+			glDeleteSync(fence);
+			job.allocated = NULL;
+			std::unique_ptr<Job> ready = std::move(_allocating[i]);
+			_allocating.erase(_allocating.begin() + i);
+			_StartUpload(std::move(ready));
+		}
+		for (size_t i = 0; i < _waiting.size();){
+			Job& job = *_waiting[i];
+			StreamedTexture* original = job.target->cancelled ? NULL : _Original(job.key);
+			if (original && !original->done){
+				i++;
+				continue;
+			}
+			std::unique_ptr<Job> next = std::move(_waiting[i]);
+			_waiting.erase(_waiting.begin() + i);
+			if (next->target->cancelled)
+				_Cancel(*next);
+			else if (original)
+				_ShareStorage(*next, *original);
+			else
+				_Allocate(std::move(next));
+		}
+		for (;;){
+			std::unique_ptr<Job> job;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (_decoded.empty())
+					return;
+				job = std::move(_decoded.front());
+				_decoded.pop_front();
+			}
+			StreamedTexture& target = *job->target;
+			_stats.decode_ms += job->decode_ms;
+			if (target.cancelled){
+				_Cancel(*job);
+				continue;
+			}
+			if (!job->ok){
+				target.failed = true;
+				_stats.failed++;
+				continue;
+			}
+			target.key = job->key;
+			StreamedTexture* original = _Original(job->key);
+			if (original && original->done){
+				_ShareStorage(*job, *original);
+				continue;
+			}
+			if (original){
+				_waiting.push_back(std::move(job));
+				continue;
+			}
+			bool in_place = !_allocator;
+			_Allocate(std::move(job));
+			if (in_place)
+				return;
+		}
+	}
+
+	// The texture, complete or streaming, that an image with key would copy.
+	StreamedTexture* _Original(hash64_t key)
+	{
+		_finished.erase(std::remove_if(_finished.begin(), _finished.end(),
+			[](const std::weak_ptr<StreamedTexture>& texture){ return texture.expired() || texture.lock()->cancelled; }), _finished.end());
+		for (size_t i = 0; i < _finished.size(); i++){
+			std::shared_ptr<StreamedTexture> texture = _finished[i].lock();
+			if (texture->key == key)
+				return texture.get();
+		}
+		for (size_t i = 0; i < _allocating.size(); i++)
+			if (_allocating[i]->key == key && !_allocating[i]->target->cancelled)
+				return _allocating[i]->target.get();
+		for (size_t i = 0; i < _active.size(); i++)
+			if (_active[i]->key == key && !_active[i]->target->cancelled && !_active[i]->target->done)
+				return _active[i]->target.get();
+		return NULL;
+	}
+
+	// The name is from glGenTextures, so binding it creates the texture.
+	// Runs on either context.
+	static void _CreateStorage(GLuint texture, GLsizei levels, GLenum format, int width, int height)
+	{
+		GLint bound = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, levels, format, width, height);
+		glBindTexture(GL_TEXTURE_2D, (GLuint)bound);
+	}
+
+	void _Allocate(std::unique_ptr<Job> job)
+	{
+		const DecodedImage& image = job->image;
+		GLuint texture = job->target->texture;
+		GLsizei levels = image.levels();
+		GLenum format = image_format(image, job->srgb);
+		int width = image.width, height = image.height;
+		if (!_allocator){
+			_CreateStorage(texture, levels, format, width, height);
+			_StartUpload(std::move(job));
+			return;
+		}
+		Job* pending = job.get();
+		_allocating.push_back(std::move(job));
+		_allocator->submit([pending, texture, levels, format, width, height]{
+			_CreateStorage(texture, levels, format, width, height);
+			GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			pending->allocated = fence;
+		});
+	}
+
+	// Storage exists: show the smallest level first.
+	void _StartUpload(std::unique_ptr<Job> job)
+	{
+		StreamedTexture& target = *job->target;
+		if (target.cancelled){
+			_Cancel(*job);
+			return;
+		}
+		const DecodedImage& image = job->image;
+		target.levels = image.levels();
+		target.resolution = glm::vec3(image.width, image.height, 1.0f);
+		target.bytes = image.pixels.size();
+		target.base_level = target.levels - 1;
+		glTextureParameteri(target.texture, GL_TEXTURE_BASE_LEVEL, target.base_level);
+		glTextureParameteri(target.texture, GL_TEXTURE_MAX_LEVEL, target.levels - 1);
+		job->level = target.levels - 1;
+		job->row = 0;
+		_active.push_back(std::move(job));
+	}
+
+	// job's image is a copy of original's: sample original's storage.
+	void _ShareStorage(Job& job, const StreamedTexture& original)
+	{
+		StreamedTexture& target = *job.target;
+		glTextureView(target.texture, GL_TEXTURE_2D, original.texture, image_format(job.image, job.srgb), 0, original.levels, 0, 1);
+		target.levels = original.levels;
+		target.resolution = original.resolution;
+		target.view = true;
+		target.done = true;
+		_stats.completed++;
+		_stats.views++;
+		_finished.push_back(job.target);
+		_ReleasePixels(job.image);
+	}
+
+	// The active job whose pending level is the smallest; its band goes next.
+	Job* _Next()
+	{
+		Job* next = NULL;
+		size_t smallest = 0;
+		for (size_t i = 0; i < _active.size(); i++){
+			Job* job = _active[i].get();
+			if (job->target->done)
+				continue;
+			if (job->target->cancelled){
+				_Cancel(*job);
+				job->target->done = true;
+				continue;
+			}
+			size_t bytes = job->image.level_bytes(job->level);
+			if (next == NULL || bytes < smallest){
+				next = job;
+				smallest = bytes;
+			}
+		}
+		return next;
+	}
+
+	// Let the texture sample the level just completed and step to the next.
+	void _FinishLevel(Job& job)
+	{
+		StreamedTexture& target = *job.target;
+		target.base_level = job.level;
+		glTextureParameteri(target.texture, GL_TEXTURE_BASE_LEVEL, job.level);
+		job.row = 0;
+		if (job.level-- > 0)
+			return;
+		target.done = true;
+		_stats.completed++;
+		_finished.push_back(job.target);
+		_ReleasePixels(job.image);
+	}
+
+	// Unmapping a large decoded image takes milliseconds; leave it to a worker.
+	void _ReleasePixels(DecodedImage& image)
+	{
+		std::shared_ptr<std::vector<unsigned char>> pixels = std::make_shared<std::vector<unsigned char>>();
+		pixels->swap(image.pixels);
+		_pool->submit([pixels]{});
+	}
+
+	void _Cancel(Job& job)
+	{
+		_stats.cancelled++;
+		_Drop(job);
+	}
+
+	// Delete a released texture now that no thread uses its name.
+	void _Drop(Job& job)
+	{
+		GLsync fence = job.allocated;
+		if (fence != NULL)
+			glDeleteSync(fence);
+		job.allocated = NULL;
+		if (job.target->released && job.target->texture != 0){
+			glDeleteTextures(1, &job.target->texture);
+			job.target->texture = 0;
+		}
+	}
+
+	void _WaitFence(int slot)
+	{
+		if (!_fences[slot])
+			return;
+		GLenum r = glClientWaitSync(_fences[slot], 0, 0);
+		while (r == GL_TIMEOUT_EXPIRED)
+			r = glClientWaitSync(_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(_fences[slot]);
+		_fences[slot] = 0;
+	}
+
+	std::unique_ptr<ThreadPool> _pool;
+	std::deque<std::unique_ptr<Job>> _decoded;
+	std::mutex _mutex;
+	std::atomic<bool> _cancel{ false };
+	std::unique_ptr<ThreadPool> _allocator;	// one thread, _context current
+	SharedContext _context;
+	std::vector<std::unique_ptr<Job>> _waiting;		// copies of a texture still streaming
+	std::vector<std::unique_ptr<Job>> _allocating;
+	std::vector<std::unique_ptr<Job>> _active;
+	std::vector<std::weak_ptr<StreamedTexture>> _finished;
+
+	size_t _budget = 0;
+	GLuint _buffer = 0;
+	unsigned char* _mapped = NULL;
+	int _slot = RING_SIZE - 1;
+	GLsync _fences[RING_SIZE];
+	TextureStreamerStats _stats;
+};
+
+#endif
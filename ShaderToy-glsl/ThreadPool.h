@@ -0,0 +1,171 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Fixed set of worker threads draining a bounded job queue. submit() blocks
+// while the queue is full, so a producer that outruns the workers is slowed
+// down instead of piling up memory. max_queued == 0 allows four queued jobs
+// per worker. Background workers run at the lowest normal priority, so they
+// rarely take a core from a thread drawing a frame but still make progress
+// when every core is busy.
+class ThreadPool
+{
+public:
+	// threads == 0 picks one per hardware thread.
+	explicit ThreadPool(unsigned int threads = 0, size_t max_queued = 0, bool background = false)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		_max_queued = max_queued > 0 ? max_queued : 4 * threads;
+		for (unsigned int i = 0; i < threads; i++)
+			_workers.push_back(std::thread(&ThreadPool::_WorkerLoop, this, background));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_job_available.notify_all();
+		for (size_t i = 0; i < _workers.size(); i++)
+			_workers[i].join();
+	}
+
+	void submit(std::function<void()> job)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_slot_available.wait(lock, [this]{ return _jobs.size() < _max_queued; });
+		_jobs.push_back(std::move(job));
+		_job_available.notify_one();
+	}
+
+	// Block until every submitted job has run.
+	void wait_idle()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_idle.wait(lock, [this]{ return _jobs.empty() && _running == 0; });
+	}
+
+	size_t size() const
+	{
+		return _workers.size();
+	}
+
+private:
+	void _WorkerLoop(bool background)
+	{
+		if (background){
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+			// batch threads never preempt a thread that is running when they
+			// wake up; Linux applies nice values per thread
+			sched_param param = {};
+			pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+			setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+		}
+		for (;;){
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_job_available.wait(lock, [this]{ return _stop || !_jobs.empty(); });
+				if (_jobs.empty())
+					return;
+				job = std::move(_jobs.front());
+				_jobs.pop_front();
+				_running++;
+			}
+			_slot_available.notify_one();
+			job();
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_running--;
+				if (_jobs.empty() && _running == 0)
+					_idle.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _jobs;
+	std::mutex _mutex;
+	std::condition_variable _job_available;
+	std::condition_variable _slot_available;
+	std::condition_variable _idle;
+	size_t _max_queued = 0;
+	unsigned int _running = 0;
+	bool _stop = false;
+};
+
+// Split [0, count) into up to bands ranges and call work(first, last) on
+// each, on pool's workers and the calling thread together; returns once every
+// range is done. The caller takes ranges too, so a busy pool only slows it
+// down, and pool == NULL runs everything on the caller.
+inline void parallel_bands(ThreadPool* pool, int count, int bands, const std::function<void(int, int)>& work)
+{
+	struct State
+	{
+		std::function<void(int, int)> work;
+		int count = 0;
+		int bands = 0;
+		std::atomic<int> next{ 0 };
+		int done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		// Take ranges until none are left. Workers that start late find none
+		// and never touch work.
+		void run()
+		{
+			for (;;){
+				int band = next++;
+				if (band >= bands)
+					return;
+				work((int)((long long)count * band / bands), (int)((long long)count * (band + 1) / bands));
+				std::lock_guard<std::mutex> lock(mutex);
+				if (++done == bands)
+					finished.notify_all();
+			}
+		}
+	};
+	if (count <= 0)
+		return;
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->work = work;
+	state->count = count;
+	state->bands = std::max(1, std::min(count, bands));
+	int helpers = pool ? (int)std::min(pool->size(), (size_t)state->bands - 1) : 0;
+	for (int i = 0; i < helpers; i++)
+		pool->submit([state]{ state->run(); });
+	state->run();
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]{ return state->done == state->bands; });
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef TILED_STILL_H
+#define TILED_STILL_H
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include "FullscreenTriangle.h"
+#include "RenderGraph.h"
+#include "Headless.h"
+#include "ShaderToyInputs.h"
+
+// Largest square tile the driver can render and read back in one draw.
+inline int max_tile_size(int requested)
+{
+	GLint viewport[2] = { 0, 0 };
+	GLint texture = 0;
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture);
+	int limit = std::min(std::min((int)viewport[0], (int)viewport[1]), (int)texture);
+	return limit > 0 ? std::min(requested, limit) : requested;
+}
+
+// Renders one frame of a single-pass graph as a width x height still that
+// may be far larger than any render target. The canvas is cut into tiles of
+// target's size; each tile is drawn with iTileOffset set to its position, so
+// gl_FragCoord and iResolution describe the full canvas. Every tile is read
+// back before the next one is drawn, which keeps each GPU submission short
+// enough for the driver watchdog. Finished tile rows are written to a binary
+// PPM top to bottom, so memory use is one tile row, not the whole image.
+inline bool render_tiled_still(RenderGraph& graph, FullscreenTriangle& quad, RenderTarget& target,
+	ShaderToyInputs inputs, int width, int height, const std::string& path)
+{
+	if (graph.order().size() != 1 || graph.has_feedback()){
+		printf("Tiled stills need a single-pass shader; buffers would only see one tile\n");
+		return false;
+	}
+	graph.set_frag_coord_remap(true);
+	if (!graph.wait_ready())
+		return false;
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (fp == NULL){
+		printf("Can not write %s\n", path.c_str());
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+	int tile_w = target.width();
+	int tile_h = target.height();
+	size_t row_bytes = (size_t)width * 3;
+	std::vector<unsigned char> band(row_bytes * tile_h);
+	inputs.iResolution = glm::vec3(width, height, 0);
+	ShaderToyInputsRing inputs_ring;
+	inputs_ring.init();
+
+	int bands = (height + tile_h - 1) / tile_h;
+	int columns = (width + tile_w - 1) / tile_w;
+	bool ok = true;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, width);
+	// bands from the top of the image down, since PPM rows are top first
+	for (int b = 0; b < bands && ok; b++){
+		int y1 = height - b * tile_h;
+		int y0 = std::max(0, y1 - tile_h);
+		int band_h = y1 - y0;
+		for (int c = 0; c < columns; c++){
+			int x0 = c * tile_w;
+			int tw = std::min(tile_w, width - x0);
+			graph.set_tile_offset(glm::vec2(x0, y0));
+			inputs_ring.upload(inputs);
+			graph.render(quad);
+			inputs_ring.end_frame();
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, target.framebuffer());
+			glReadPixels(0, 0, tw, band_h, GL_RGB, GL_UNSIGNED_BYTE, &band[(size_t)x0 * 3]);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		}
+		// GL rows are bottom first
+		for (int y = band_h - 1; y >= 0 && ok; y--)
+			ok = fwrite(&band[(size_t)y * row_bytes], 1, row_bytes, fp) == row_bytes;
+		printf("\rtiled still: %d/%d rows", height - y0, height);
+		fflush(stdout);
+	}
+	printf("\n");
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	graph.set_tile_offset(glm::vec2(0.0f));
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+		printf("Failed writing %s\n", path.c_str());
+	return ok;
+}
+
+#endif
@@ -0,0 +1,334 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glew.h>
+#include <glm/glm.hpp>
+#include "FullscreenTriangle.h"
+#include "Shader.h"
+#include "RenderGraph.h"
+#include "Headless.h"
+#include "GpuTimer.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+using namespace std;
+using glm::vec3;
+using glm::vec4;
+
+// shadertoy-bench: renders every shader/*_frag.glsl at a set of resolutions
+// offscreen, times the frames on the GPU and reports the results as JSON.
+// Given a baseline file from an earlier run it exits non-zero when a shader
+// got slower than the threshold allows, so it can gate CI on machines without
+// a GPU (llvmpipe).
+
+struct BenchOptions
+{
+	vector<string> shaders;
+	vector<glm::ivec2> resolutions;
+	int warmup = 10;
+	int frames = 60;
+	string out;
+	string baseline;
+	double threshold = 10.0;	// percent
+};
+
+struct BenchResult
+{
+	string shader;
+	int width = 0;
+	int height = 0;
+	bool ok = false;
+	GpuTimerStats stats;
+	double mpixels_per_s = 0.0;
+};
+
+vector<string> list_fragment_shaders(const string& dir) {
+	vector<string> files;
+	const string suffix = "_frag.glsl";
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "/*" + suffix).c_str(), &data);
+	if (h != INVALID_HANDLE_VALUE) {
+		do {
+			files.push_back(dir + "/" + data.cFileName);
+		} while (FindNextFileA(h, &data));
+		FindClose(h);
+	}
+#else
+	DIR* d = opendir(dir.c_str());
+	if (d) {
+		while (struct dirent* e = readdir(d)) {
+			string name = e->d_name;
+			if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+				files.push_back(dir + "/" + name);
+		}
+		closedir(d);
+	}
+#endif
+	sort(files.begin(), files.end());
+	return files;
+}
+
+bool parse_resolutions(const char* arg, vector<glm::ivec2>& out) {
+	out.clear();
+	string list = arg;
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == string::npos) end = list.size();
+		glm::ivec2 r;
+		if (sscanf(list.substr(pos, end - pos).c_str(), "%dx%d", &r.x, &r.y) != 2 || r.x <= 0 || r.y <= 0)
+			return false;
+		out.push_back(r);
+		pos = end + 1;
+	}
+	return !out.empty();
+}
+
+bool parse_options(int argc, char** argv, BenchOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--resolutions") == 0 && has_value) {
+			if (!parse_resolutions(argv[++i], options.resolutions)) {
+				printf("--resolutions expects WxH[,WxH...]\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--warmup") == 0 && has_value)
+			options.warmup = max(0, atoi(argv[++i]));
+		else if (strcmp(arg, "--frames") == 0 && has_value)
+			options.frames = max(1, atoi(argv[++i]));
+		else if (strcmp(arg, "--out") == 0 && has_value)
+			options.out = argv[++i];
+		else if (strcmp(arg, "--baseline") == 0 && has_value)
+			options.baseline = argv[++i];
+		else if (strcmp(arg, "--threshold") == 0 && has_value)
+			options.threshold = atof(argv[++i]);
+		else if (strncmp(arg, "--", 2) == 0) {
+			printf("usage: shadertoy-bench [--resolutions 640x360,...] [--warmup N] [--frames N]\n"
+				"                       [--out results.json] [--baseline old.json] [--threshold percent] [frag.glsl ...]\n");
+			return false;
+		}
+		else
+			options.shaders.push_back(arg);
+	}
+	if (options.shaders.empty())
+		options.shaders = list_fragment_shaders("shader");
+	if (options.resolutions.empty())
+		parse_resolutions("640x360,1280x720,1920x1080,3840x2160", options.resolutions);
+	return true;
+}
+
+BenchResult bench_shader(FullscreenTriangle& quad, const BenchOptions& options, const string& shader, glm::ivec2 size) {
+	BenchResult result;
+	result.shader = shader;
+	result.width = size.x;
+	result.height = size.y;
+
+	RenderGraph graph;
+	graph.set_pass(PASS_IMAGE, shader);
+	if (!graph.build(size.x, size.y))
+		return result;
+	RenderTarget target;
+	target.init(size.x, size.y);
+	graph.set_output(target.framebuffer());
+	GpuTimer timer(options.frames);
+	graph.set_timer(&timer);
+	if (!graph.wait_ready())
+		return result;
+
+	ShaderToyInputsRing inputs_ring;
+	inputs_ring.init();
+	ShaderToyInputs inputs = {};
+	inputs.iResolution = vec3(size.x, size.y, 0);
+	inputs.iSampleRate = 44100.0f;
+	inputs.iTimeDelta = 1.0f / 60.0f;
+	inputs.iFrameRate = 60.0f;
+	inputs.iDate = vec4(2000, 0, 1, 0);
+	for (int frame = 0; frame < options.warmup + options.frames; frame++) {
+		if (frame == options.warmup) {
+			glFinish();
+			timer.reset();
+		}
+		inputs.iFrame = frame;
+		inputs.iTime = frame / 60.0f;
+		timer.begin_frame();
+		inputs_ring.upload(inputs);
+		graph.render(quad);
+		inputs_ring.end_frame();
+		timer.end_frame();
+	}
+	glFinish();
+	timer.collect();
+	result.stats = timer.stats(0);
+	result.ok = result.stats.samples > 0;
+	if (result.ok && result.stats.avg_ms > 0.0)
+		result.mpixels_per_s = (double)size.x * size.y / (result.stats.avg_ms * 1000.0);
+	return result;
+}
+
+string json_escape(const string& s) {
+	string out;
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') out += '\\';
+		out += s[i];
+	}
+	return out;
+}
+
+string results_to_json(const BenchOptions& options, const vector<BenchResult>& results) {
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	string json = "{\n";
+	json += "  \"renderer\": \"" + json_escape(renderer ? renderer : "") + "\",\n";
+	json += "  \"version\": \"" + json_escape(version ? version : "") + "\",\n";
+	json += "  \"warmup\": " + to_string(options.warmup) + ",\n";
+	json += "  \"frames\": " + to_string(options.frames) + ",\n";
+	json += "  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		char line[512];
+		if (r.ok)
+			snprintf(line, sizeof(line),
+				"%s\n    {\"shader\": \"%s\", \"width\": %d, \"height\": %d, \"ms_per_frame\": %.4f, \"mpixels_per_s\": %.2f, "
+				"\"min_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"samples\": %u}",
+				i ? "," : "", json_escape(r.shader).c_str(), r.width, r.height, r.stats.avg_ms, r.mpixels_per_s,
+				r.stats.min_ms, r.stats.p50_ms, r.stats.p95_ms, r.stats.p99_ms, r.stats.samples);
+		else
+			snprintf(line, sizeof(line), "%s\n    {\"shader\": \"%s\", \"width\": %d, \"height\": %d, \"error\": true}",
+				i ? "," : "", json_escape(r.shader).c_str(), r.width, r.height);
+		json += line;
+	}
+	json += "\n  ]\n}\n";
+	return json;
+}
+
+// Reads the "results" entries of a file written by results_to_json(). Only
+// that format is understood, not JSON in general.
+bool load_baseline(const string& path, vector<BenchResult>& out) {
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (fp == NULL)
+		return false;
+	string text;
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		text.append(buffer, n);
+	fclose(fp);
+
+	for (size_t pos = text.find("{\"shader\""); pos != string::npos; pos = text.find("{\"shader\"", pos + 1)) {
+		string entry = text.substr(pos, text.find('}', pos) - pos);
+		BenchResult r;
+		size_t name = entry.find("\"shader\": \"");
+		if (name == string::npos)
+			continue;
+		name += 11;
+		r.shader = entry.substr(name, entry.find('"', name) - name);
+		size_t field;
+		if ((field = entry.find("\"width\": ")) != string::npos) r.width = atoi(entry.c_str() + field + 9);
+		if ((field = entry.find("\"height\": ")) != string::npos) r.height = atoi(entry.c_str() + field + 10);
+		if ((field = entry.find("\"ms_per_frame\": ")) != string::npos) r.stats.avg_ms = atof(entry.c_str() + field + 16);
+		if ((field = entry.find("\"p50_ms\": ")) != string::npos) r.stats.p50_ms = atof(entry.c_str() + field + 10);
+		r.ok = entry.find("\"error\"") == string::npos;
+		out.push_back(r);
+	}
+	return true;
+}
+
+// Compares medians, which are less noisy than means. Returns the number of
+// regressions beyond threshold percent.
+int compare_to_baseline(const vector<BenchResult>& results, const vector<BenchResult>& baseline, double threshold) {
+	int regressions = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		for (size_t b = 0; b < baseline.size(); b++) {
+			const BenchResult& base = baseline[b];
+			if (base.shader != r.shader || base.width != r.width || base.height != r.height || !base.ok)
+				continue;
+			if (!r.ok || base.stats.p50_ms <= 0.0)
+				break;
+			double change = (r.stats.p50_ms / base.stats.p50_ms - 1.0) * 100.0;
+			bool regressed = change > threshold;
+			printf("%s %s %dx%d: %.3f ms -> %.3f ms (%+.1f%%)\n", regressed ? "REGRESSION" : "ok        ",
+				r.shader.c_str(), r.width, r.height, base.stats.p50_ms, r.stats.p50_ms, change);
+			if (regressed)
+				regressions++;
+			break;
+		}
+	}
+	return regressions;
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	if (!parse_options(argc, argv, options))
+		return 2;
+	if (options.shaders.empty()) {
+		printf("No shaders to benchmark\n");
+		return 2;
+	}
+	HeadlessContext context;
+	if (!context.init())
+		return 2;
+	// the bench measures rendering, not loading; skip the disk cache
+	ProgramCache::instance().set_enabled(false);
+
+	vector<BenchResult> results;
+	bool failed = false;
+	{
+		FullscreenTriangle quad;
+		quad.init();
+		for (size_t s = 0; s < options.shaders.size(); s++) {
+			for (size_t r = 0; r < options.resolutions.size(); r++) {
+				BenchResult result = bench_shader(quad, options, options.shaders[s], options.resolutions[r]);
+				if (result.ok)
+					printf("%-40s %5dx%-5d %9.3f ms/frame %9.1f Mpix/s  p50 %.3f  p95 %.3f  p99 %.3f\n",
+						result.shader.c_str(), result.width, result.height, result.stats.avg_ms, result.mpixels_per_s,
+						result.stats.p50_ms, result.stats.p95_ms, result.stats.p99_ms);
+				else {
+					printf("%-40s %5dx%-5d failed\n", result.shader.c_str(), result.width, result.height);
+					failed = true;
+				}
+				results.push_back(result);
+			}
+		}
+	}
+
+	string json = results_to_json(options, results);
+	if (options.out.empty())
+		fputs(json.c_str(), stdout);
+	else {
+		FILE* fp = fopen(options.out.c_str(), "wb");
+		if (fp == NULL || fputs(json.c_str(), fp) < 0) {
+			printf("Can not write %s\n", options.out.c_str());
+			failed = true;
+		}
+		if (fp) fclose(fp);
+	}
+
+	if (!options.baseline.empty()) {
+		vector<BenchResult> baseline;
+		if (!load_baseline(options.baseline, baseline)) {
+			printf("Can not read baseline %s\n", options.baseline.c_str());
+			return 2;
+		}
+		int regressions = compare_to_baseline(results, baseline, options.threshold);
+		if (regressions > 0) {
+			printf("%d regression(s) above %.1f%%\n", regressions, options.threshold);
+			return 1;
+		}
+	}
+	return failed ? 2 : 0;
+}
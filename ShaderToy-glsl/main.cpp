@@ -1,20 +1,43 @@
 #include <vector>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <chrono>
+#include <thread>
 
 #include<iostream>
 #include<time.h>
 #include <assert.h>
 #include <glew.h>
-#include<GLFW\glfw3.h>
+#include <GLFW/glfw3.h>
 #include <gli/gli.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "FullscreenTriangle.h"
 #include "Model.h"
+#include "Instancing.h"
+#include "AssetLoader.h"
 #include "Shader.h"
+#include "RenderGraph.h"
+#include "Headless.h"
+#include "FrameCapture.h"
+#include "TiledStill.h"
+#include "GpuTimer.h"
+#include "DynamicResolution.h"
+#include "Interleave.h"
+#include "FrameClock.h"
+#include "DxtCompressor.h"
+#include "FileUtil.h"
+#include "MappedFile.h"
+#include <soil/SOIL.h>
+extern "C" {
+#include <soil/image_DXT.h>
+#include <soil/image_helper.h>
+}
 using namespace std;
 using glm::vec2;
 using glm::vec3;
@@ -26,6 +49,15 @@ GLFWwindow* window;
 
 
 void init_glfw_glew();
+void bench_uniforms(const char* vert_path, const char* frag_path, vec3 iResolution);
+void bench_models(const char* vert_path, const char* frag_path, int count, const char* model_path);
+void bench_assets(vector<string> files);
+void bench_optimize(const vector<string>& files);
+void bench_instances(int count, vector<string> files);
+void bench_textures(double budget_mb, const vector<string>& files);
+void bench_dxt(const vector<string>& files);
+void bench_mips(const vector<string>& files);
+void bench_dds(const vector<string>& files);
 
 void init_glfw_glew() {
 	// Initialize GLFW
@@ -57,35 +89,1376 @@ void init_glfw_glew() {
 	glfwSetCursorPos(window, WIDTH / 2, HEIGHT / 2);
 	GLEW_ARB_debug_output;
 }
+// Compares the per-frame uniform traffic of the old name-based path
+// (glGetUniformLocation + glUniform per bind), pre-resolved handles and the
+// ShaderToyInputs ring buffer.
+void bench_uniforms(const char* vert_path, const char* frag_path, vec3 iResolution) {
+	const int frames = 10000;
+	Shader loose;
+	loose.init(vert_path, frag_path, false);
+	GLuint program = loose.get_program();
+	loose.use();
+
+	double t0 = glfwGetTime();
+	for (int i = 0; i < frames; i++) {
+		glUniform3fv(glGetUniformLocation(program, "iResolution"), 1, &iResolution[0]);
+		glUniform1f(glGetUniformLocation(program, "iTime"), i * 0.016f);
+	}
+	glFinish();
+	double by_name = glfwGetTime() - t0;
+
+	Uniform<vec3> u_resolution = loose.uniform<vec3>("iResolution");
+	Uniform<float> u_time = loose.uniform<float>("iTime");
+	ShaderStats before = Shader::stats();
+	t0 = glfwGetTime();
+	for (int i = 0; i < frames; i++) {
+		loose.set(u_resolution, iResolution);
+		loose.set(u_time, i * 0.016f);
+	}
+	glFinish();
+	double by_handle = glfwGetTime() - t0;
+	ShaderStats after = Shader::stats();
+
+	ShaderToyInputsRing ring;
+	ring.init();
+	ShaderToyInputs inputs = {};
+	inputs.iResolution = iResolution;
+	t0 = glfwGetTime();
+	for (int i = 0; i < frames; i++) {
+		inputs.iTime = i * 0.016f;
+		inputs.iFrame = i;
+		ring.upload(inputs);
+		ring.end_frame();
+	}
+	glFinish();
+	double by_block = glfwGetTime() - t0;
+
+	printf("uniform binds, %d frames\n", frames);
+	printf("  by name:   4 GL calls/frame, %.3f us/frame\n", by_name * 1e6 / frames);
+	printf("  by handle: %.1f GL calls/frame, %.3f us/frame\n",
+		(double)(after.uniform_uploads + after.location_queries - before.uniform_uploads - before.location_queries) / frames,
+		by_handle * 1e6 / frames);
+	printf("  by block:  1 memcpy + 2 GL calls/frame for every built-in, %.3f us/frame\n", by_block * 1e6 / frames);
+}
+
+// Compares the CPU cost of drawing many models the way Model::render() used
+// to, binding every buffer and re-specifying each attribute per draw, with
+// binding the vertex array each Model now builds once. The viewport is one
+// pixel so the GPU barely works; only the time to issue the draws counts.
+// Loading is timed too: the first load of model_path imports it, the rest
+// come from the mesh cache (all of them on a second run).
+void bench_models(const char* vert_path, const char* frag_path, int count, const char* model_path) {
+	const int frames = 100;
+	vector<unique_ptr<Model>> models;
+	double first_ms = 0.0;
+	chrono::steady_clock::time_point load_start = chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		unique_ptr<Model> model(new Model());
+		model->init(model_path, false, true, false, false);
+		if (model->vertexArray == 0)
+			return;
+		if (i == 0) {
+			glFinish();
+			first_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - load_start).count();
+		}
+		models.push_back(move(model));
+	}
+	glFinish();
+	double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - load_start).count();
+	Shader shader;
+	shader.init(vert_path, frag_path, false);
+	shader.use();
+	glViewport(0, 0, 1, 1);
+	GLuint scratch;
+	glGenVertexArrays(1, &scratch);
+
+	double respecify = 0.0;
+	for (int f = 0; f < frames; f++) {
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		glBindVertexArray(scratch);
+		for (int i = 0; i < count; i++) {
+			Model& model = *models[i];
+			glBindBuffer(GL_ARRAY_BUFFER, model.vertexBuffer);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, model.Stride(), (void*)0);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, model.Stride(), (void*)(3 * sizeof(float)));
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.elementBuffer);
+			glDrawElements(GL_TRIANGLES, (GLsizei)model.IndexCount(), model.IndexType(), (void*)0);
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+		}
+		respecify += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		glFinish();
+	}
+
+	double bound = 0.0;
+	for (int f = 0; f < frames; f++) {
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+			models[i]->render();
+		bound += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		glFinish();
+	}
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &scratch);
+
+	printf("loaded %d x %s (%u vertices) in %.1f ms, first %.2f ms, others %.3f ms each\n", count, model_path,
+		models[0]->VertexCount(), load_ms, first_ms, count > 1 ? (load_ms - first_ms) / (count - 1) : 0.0);
+	MeshCache::instance().print_stats();
+	printf("draw cost of %d models, average of %d frames:\n", count, frames);
+	printf("  re-specified attributes: 9 GL calls/draw, %.3f ms/frame, %.2f us/draw\n",
+		respecify * 1e3 / frames, respecify * 1e6 / frames / count);
+	printf("  prebuilt vertex array:   2 GL calls/draw, %.3f ms/frame, %.2f us/draw\n",
+		bound * 1e3 / frames, bound * 1e6 / frames / count);
+}
+
+// Stress test of the asset loader: imports every file (fewer than 128 are
+// repeated up to 128) with the mesh cache off, first serially through
+// Model::init() and then through AssetLoader with 1, 2, 4, ... threads up to
+// the hardware threads. The GL thread polls upload() like a render loop
+// would and the time until the first model is ready is reported too.
+void bench_assets(vector<string> files) {
+	if (files.empty())
+		files.push_back("quad.obj");
+	size_t given = files.size();
+	while (files.size() < 128)
+		files.push_back(files[files.size() % given]);
+	MeshCache::instance().set_enabled(false);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		vector<unique_ptr<Model>> models;
+		for (size_t i = 0; i < files.size(); i++) {
+			models.push_back(unique_ptr<Model>(new Model()));
+			models.back()->init(files[i], true, true, false, false);
+		}
+		glFinish();
+	}
+	double serial_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	printf("%u models, serial Model::init: %.1f ms\n", (unsigned int)files.size(), serial_ms);
+
+	unsigned int hardware = max(1u, thread::hardware_concurrency());
+	for (unsigned int threads = 1; ; threads = min(threads * 2, hardware)) {
+		vector<unique_ptr<Model>> models;
+		double first_ms = -1.0;
+		start = chrono::steady_clock::now();
+		{
+			AssetLoader loader(threads);
+			for (size_t i = 0; i < files.size(); i++) {
+				models.push_back(unique_ptr<Model>(new Model()));
+				loader.load(*models.back(), files[i], true, true, false, false);
+			}
+			while (loader.pending() > 0) {
+				if (loader.upload() == 0) {
+					this_thread::sleep_for(chrono::milliseconds(1));
+					continue;
+				}
+				if (first_ms < 0.0)
+					first_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			}
+			glFinish();
+			double total_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			printf("%2u threads: %8.1f ms, first ready after %6.1f ms, %.2fx serial, %u failed\n",
+				threads, total_ms, first_ms, serial_ms / total_ms, loader.stats().failed);
+		}
+		if (threads == hardware)
+			break;
+	}
+	MeshCache::instance().set_enabled(true);
+}
+
+// Runs the mesh optimization stages one by one on each file's imported index
+// buffer and prints the simulated vertex cache efficiency after each, with
+// the time taken and the index buffer size before and after.
+void bench_optimize(const vector<string>& files) {
+	MeshCache::instance().set_enabled(false);
+	printf("%-24s %-14s %8s %8s %10s\n", "model", "stage", "ACMR", "ATVR", "ms");
+	for (size_t f = 0; f < files.size(); f++) {
+		Model model;
+		model.init(files[f], false, false, false, false);
+		if (!model.ready())
+			continue;
+		vector<unsigned int> indices = model.Triangles();
+		vector<vec3> positions = model.Vertices();
+		size_t vertices = positions.size();
+		VertexCacheStats stats = analyze_vertex_cache(&indices[0], indices.size(), vertices);
+		printf("%-24s %-14s %8.3f %8.3f %10s\n", files[f].c_str(), "imported", stats.acmr, stats.atvr, "");
+
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		optimize_vertex_cache(&indices[0], &indices[0], indices.size(), vertices);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		stats = analyze_vertex_cache(&indices[0], indices.size(), vertices);
+		printf("%-24s %-14s %8.3f %8.3f %10.2f\n", "", "vertex cache", stats.acmr, stats.atvr, ms);
+
+		t0 = chrono::steady_clock::now();
+		optimize_overdraw(&indices[0], &indices[0], indices.size(), &positions[0].x, vertices, 3);
+		ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		stats = analyze_vertex_cache(&indices[0], indices.size(), vertices);
+		printf("%-24s %-14s %8.3f %8.3f %10.2f\n", "", "overdraw", stats.acmr, stats.atvr, ms);
+
+		t0 = chrono::steady_clock::now();
+		vector<unsigned int> remap;
+		size_t used = optimize_vertex_fetch(remap, &indices[0], indices.size(), vertices);
+		remap_vertices(positions, remap, used);
+		ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		stats = analyze_vertex_cache(&indices[0], indices.size(), used);
+		printf("%-24s %-14s %8.3f %8.3f %10.2f\n", "", "vertex fetch", stats.acmr, stats.atvr, ms);
+
+		size_t before = indices.size() * sizeof(unsigned int);
+		size_t after = indices.size() * (used <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int));
+		printf("%-24s index buffer %u -> %u bytes (%.0f%% smaller)\n", "", (unsigned int)before, (unsigned int)after,
+			100.0 * (before - after) / before);
+	}
+	MeshCache::instance().set_enabled(true);
+}
+
+// Draws count instances spread over the given meshes (quad.obj by default),
+// first as one Model::render() per instance with the instance index set as a
+// constant attribute, then through InstanceBatch with one multi-draw per
+// frame, both with unchanged and with rewritten transforms. Both paths read
+// the same instance array, and a 64x64 frame of each is compared before the
+// CPU time per frame is measured in a one pixel viewport.
+void bench_instances(int count, vector<string> files) {
+	const int frames = 100;
+	if (files.empty())
+		files.push_back("quad.obj");
+	MeshArena arena;
+	arena.init(false, true, false, false);
+	vector<unique_ptr<Model>> models;
+	for (size_t f = 0; f < files.size(); f++) {
+		unique_ptr<Model> model(new Model());
+		model->init(files[f], false, true, false, false);
+		if (!model->ready() || arena.add(files[f]) < 0)
+			return;
+		models.push_back(move(model));
+	}
+	arena.build();
+	InstanceBatch batch;
+	if (!batch.init(arena, (unsigned int)count))
+		return;
+	Shader shader;
+	shader.init("shader/instanced_vert.glsl", "shader/instanced_frag.glsl", false);
+	if (!shader.ready())
+		return;
+	shader.use();
+	shader.bind_mat4("view_projection", glm::mat4(1.0f));
+
+	// a grid of small copies, each at its own depth so the image does not
+	// depend on the draw order
+	int side = (int)ceil(sqrt((double)count));
+	vector<int> mesh_of(count);
+	vector<glm::mat4> transforms(count);
+	for (int i = 0; i < count; i++) {
+		vec3 at(((i % side) + 0.5f) / side * 2.0f - 1.0f, ((i / side) + 0.5f) / side * 2.0f - 1.0f, (float)i / count - 0.5f);
+		transforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), at), vec3(0.45f / side));
+		mesh_of[i] = i % (int)models.size();
+		vec4 params((i * 37 % 255) / 255.0f, (i * 91 % 255) / 255.0f, (i * 13 % 255) / 255.0f, 1.0f);
+		batch.add(mesh_of[i], transforms[i], params);
+	}
+	// where each instance lands in the batch's array, which is grouped by mesh
+	vector<GLuint> slot_of(count);
+	vector<GLuint> next(models.size(), 0);
+	for (int i = 0; i < count; i++)
+		next[mesh_of[i]]++;
+	for (size_t m = 0, base = 0; m < models.size(); m++) {
+		GLuint n = next[m];
+		next[m] = (GLuint)base;
+		base += n;
+	}
+	for (int i = 0; i < count; i++)
+		slot_of[i] = next[mesh_of[i]]++;
+	RenderTarget target;
+	target.init(64, 64);
+	GLuint depth;
+	glCreateRenderbuffers(1, &depth);
+	glNamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, 64, 64);
+	glNamedFramebufferRenderbuffer(target.framebuffer(), GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer());
+	// upload the instances once, for the per-model path too
+	glViewport(0, 0, 1, 1);
+	batch.render();
+	glFinish();
+
+	glEnable(GL_DEPTH_TEST);
+	vector<unsigned char> images[2];
+	for (int path = 0; path < 2; path++) {
+		glViewport(0, 0, 64, 64);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (path == 0) {
+			for (int i = 0; i < count; i++) {
+				glVertexAttribI1ui(INSTANCE_INDEX_LOCATION, slot_of[i]);
+				models[mesh_of[i]]->render();
+			}
+		}
+		else
+			batch.render();
+		images[path].resize(64 * 64 * 4);
+		glReadPixels(0, 0, 64, 64, GL_RGBA, GL_UNSIGNED_BYTE, &images[path][0]);
+	}
+	glDisable(GL_DEPTH_TEST);
+	printf("%d instances of %d meshes (arena %.1f KB), images %s\n", count, (int)models.size(), arena.bytes() / 1024.0,
+		images[0] == images[1] ? "match" : "DIFFER");
+
+	glViewport(0, 0, 1, 1);
+	double per_model = 0.0;
+	for (int f = 0; f < frames; f++) {
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) {
+			glVertexAttribI1ui(INSTANCE_INDEX_LOCATION, slot_of[i]);
+			models[mesh_of[i]]->render();
+		}
+		per_model += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		glFinish();
+	}
+
+	double unchanged = 0.0;
+	for (int f = 0; f < frames; f++) {
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		batch.render();
+		unchanged += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		glFinish();
+	}
+
+	double moving = 0.0;
+	for (int f = 0; f < frames; f++) {
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		glm::mat4 shift = glm::translate(glm::mat4(1.0f), vec3(0.001f * f, 0.0f, 0.0f));
+		for (int i = 0; i < count; i++)
+			batch.set(i, shift * transforms[i], vec4(1.0f));
+		batch.render();
+		moving += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		glFinish();
+	}
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &depth);
+	target.destory();
+
+	printf("CPU cost per frame, average of %d frames:\n", frames);
+	printf("  Model::render() per instance: %d GL calls, %.3f ms\n", 3 * count, per_model * 1e3 / frames);
+	printf("  multi-draw, unchanged:        6 GL calls, %.3f ms\n", unchanged * 1e3 / frames);
+	printf("  multi-draw, all moved:        5 GL calls, %.3f ms\n", moving * 1e3 / frames);
+}
+
+// Loads each image once in place, as acquire() does without streaming, and
+// once streamed with budget_mb per frame at 60 frames per second. Reports the
+// GL thread time of the in-place load against acquire() and the worst frame
+// of the streamed one. Also the time to the first (blurry) version and to the
+// full texture, and whether both textures hold the same level 0.
+void bench_textures(double budget_mb, const vector<string>& files) {
+	const chrono::duration<double> frame_period(1.0 / 60.0);
+	TextureSettings settings;
+	for (size_t f = 0; f < files.size(); f++) {
+		TextureCache& cache = TextureCache::instance();
+		cache.disable_streaming();
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		vec3 resolution;
+		GLuint in_place = cache.acquire(files[f], settings, &resolution);
+		glFinish();
+		double in_place_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		if (in_place == 0)
+			continue;
+		vector<unsigned char> expected((size_t)resolution.x * (size_t)resolution.y * 16);
+		glGetTextureImage(in_place, 0, GL_RGBA, GL_FLOAT, (GLsizei)expected.size(), &expected[0]);
+		cache.release(in_place);
+
+		cache.enable_streaming((size_t)(budget_mb * 1024 * 1024));
+		t0 = chrono::steady_clock::now();
+		GLuint streamed = cache.acquire(files[f], settings);
+		double acquire_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		double worst_ms = 0.0, preview_ms = -1.0, done_ms = 0.0;
+		int frames = 0;
+		for (;; frames++) {
+			chrono::steady_clock::time_point frame_start = chrono::steady_clock::now();
+			cache.update();
+			chrono::steady_clock::time_point frame_end = chrono::steady_clock::now();
+			worst_ms = max(worst_ms, chrono::duration<double, milli>(frame_end - frame_start).count());
+			if (preview_ms < 0.0 && cache.resolution(streamed, resolution))
+				preview_ms = chrono::duration<double, milli>(frame_end - t0).count();
+			if (cache.streamer()->pending() == 0)
+				break;
+			glFinish();
+			this_thread::sleep_until(frame_start + chrono::duration_cast<chrono::steady_clock::duration>(frame_period));
+		}
+		done_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		vector<unsigned char> actual(expected.size());
+		glGetTextureImage(streamed, 0, GL_RGBA, GL_FLOAT, (GLsizei)actual.size(), &actual[0]);
+		printf("%s (%dx%d)\n", files[f].c_str(), (int)resolution.x, (int)resolution.y);
+		printf("  in place: %.2f ms in one frame\n", in_place_ms);
+		printf("  streamed: acquire %.2f ms, worst frame %.2f ms, blurry after %.1f ms, complete after %d frames (%.1f ms), level 0 %s\n",
+			acquire_ms, worst_ms, preview_ms, frames + 1, done_ms, actual == expected ? "matches" : "DIFFERS");
+		cache.print_stats();
+		cache.release(streamed);
+		cache.disable_streaming();
+	}
+}
+
+// Root mean square error of DXT blocks decoded against the pixels they were
+// compressed from, over RGB for DXT1 and RGBA for DXT5, in 8-bit steps.
+double dxt_rmse(const unsigned char* pixels, int width, int height, int channels, const unsigned char* blocks, DxtFormat format) {
+	int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	int step = channels < 3 ? 0 : 1;
+	double sum = 0.0;
+	for (int by = 0; by < blocks_y; by++) {
+		for (int bx = 0; bx < blocks_x; bx++) {
+			const unsigned char* block = blocks + ((size_t)by * blocks_x + bx) * (format == DXT1 ? 8 : 16);
+			int alpha[8];
+			unsigned long long alpha_bits = 0;
+			if (format == DXT5) {
+				int a0 = block[0], a1 = block[1];
+				alpha[0] = a0;
+				alpha[1] = a1;
+				for (int i = 2; i < 8; i++) {
+					if (a0 > a1)
+						alpha[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+					else
+						alpha[i] = i < 6 ? ((6 - i) * a0 + (i - 1) * a1) / 5 : (i == 6 ? 0 : 255);
+				}
+				for (int i = 0; i < 6; i++)
+					alpha_bits |= (unsigned long long)block[2 + i] << (8 * i);
+				block += 8;
+			}
+			int c[2] = { block[0] | block[1] << 8, block[2] | block[3] << 8 };
+			int palette[4][3];
+			for (int k = 0; k < 2; k++) {
+				palette[k][0] = ((c[k] >> 11) & 31) * 255 / 31;
+				palette[k][1] = ((c[k] >> 5) & 63) * 255 / 63;
+				palette[k][2] = (c[k] & 31) * 255 / 31;
+			}
+			// DXT5 color blocks always use four colors
+			bool four = c[0] > c[1] || format == DXT5;
+			for (int i = 0; i < 3; i++) {
+				palette[2][i] = four ? (2 * palette[0][i] + palette[1][i]) / 3 : (palette[0][i] + palette[1][i]) / 2;
+				palette[3][i] = four ? (palette[0][i] + 2 * palette[1][i]) / 3 : 0;
+			}
+			unsigned int bits = block[4] | block[5] << 8 | block[6] << 16 | (unsigned int)block[7] << 24;
+			for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++) {
+					const unsigned char* src = pixels + ((size_t)(by * 4 + y) * width + bx * 4 + x) * channels;
+					const int* color = palette[(bits >> (2 * (y * 4 + x))) & 3];
+					for (int i = 0; i < 3; i++)
+						sum += (double)(color[i] - src[i * step]) * (color[i] - src[i * step]);
+					if (format == DXT5) {
+						int a = (channels & 1) == 0 ? src[channels - 1] : 255;
+						int decoded = alpha[(alpha_bits >> (3 * (y * 4 + x))) & 7];
+						sum += (double)(decoded - a) * (decoded - a);
+					}
+				}
+			}
+		}
+	}
+	return sqrt(sum / ((double)width * height * (format == DXT1 ? 3 : 4)));
+}
+
+// Compresses each image (synthetic 1K, 4K and 8K RGBA images by default) to
+// DXT1 and DXT5 with SOIL's image_DXT.c, then with DxtCompressor on one
+// thread and on every hardware thread. Reports MPixels/s for each, whether
+// the output is byte for byte the same as SOIL's, and the RMSE.
+void bench_dxt(const vector<string>& files) {
+	vector<string> names = files;
+	if (names.empty()) {
+		names.push_back("1024");
+		names.push_back("4096");
+		names.push_back("8192");
+	}
+	DxtCompressor single(1);
+	DxtCompressor& threaded = DxtCompressor::instance();
+	char threaded_label[32];
+	sprintf(threaded_label, "SSE2 x%u", (unsigned int)threaded.threads());
+	printf("%-24s %-6s %10s %10s %10s %10s %8s\n", "image", "format", "SOIL", "SSE2 x1", threaded_label, "identical", "RMSE");
+	for (size_t f = 0; f < names.size(); f++) {
+		int width = 0, height = 0, channels = 0;
+		unsigned char* pixels = NULL;
+		vector<unsigned char> synthetic;
+		if (files.empty()) {
+			// smooth gradients, hard edges every 64 pixels and some noise
+			width = height = atoi(names[f].c_str());
+			channels = 4;
+			synthetic.resize((size_t)width * height * 4);
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					unsigned char* p = &synthetic[((size_t)y * width + x) * 4];
+					int noise = (int)(((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u) >> 27) - 16;
+					float u = (float)x / width, v = (float)y / height;
+					p[0] = (unsigned char)glm::clamp(128.0f + 100.0f * sin(u * 40.0f + v * 12.0f) + noise, 0.0f, 255.0f);
+					p[1] = (unsigned char)(u * 255.0f);
+					p[2] = ((x / 64 + y / 64) & 1) ? 220 : (unsigned char)glm::clamp(60 + noise * 2, 0, 255);
+					p[3] = (unsigned char)glm::clamp(255.0f * (1.5f - 2.0f * glm::length(vec2(u, v) - vec2(0.5f))), 0.0f, 255.0f);
+				}
+			}
+			pixels = &synthetic[0];
+			names[f] += "x" + names[f];
+		}
+		else {
+			pixels = SOIL_load_image(files[f].c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
+			if (pixels == NULL) {
+				printf("Can not load %s\n", files[f].c_str());
+				continue;
+			}
+		}
+		double mpixels = (double)width * height / 1e6;
+		// small images are timed best of three
+		int runs = width * height <= 1024 * 1024 ? 3 : 1;
+		for (int format = DXT1; format <= DXT5; format++) {
+			double soil_ms = 1e30, single_ms = 1e30, threaded_ms = 1e30;
+			vector<unsigned char> expected, actual;
+			for (int run = 0; run < runs; run++) {
+				chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+				int size = 0;
+				unsigned char* blocks = format == DXT1 ? convert_image_to_DXT1(pixels, width, height, channels, &size)
+					: convert_image_to_DXT5(pixels, width, height, channels, &size);
+				soil_ms = min(soil_ms, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+				expected.assign(blocks, blocks + size);
+				free(blocks);
+
+				t0 = chrono::steady_clock::now();
+				actual = single.compress(pixels, width, height, channels, (DxtFormat)format);
+				single_ms = min(single_ms, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+
+				t0 = chrono::steady_clock::now();
+				actual = threaded.compress(pixels, width, height, channels, (DxtFormat)format);
+				threaded_ms = min(threaded_ms, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+			}
+			printf("%-24s %-6s %10.1f %10.1f %10.1f %10s %8.3f\n", format == DXT1 ? names[f].c_str() : "", format == DXT1 ? "DXT1" : "DXT5",
+				mpixels / soil_ms * 1000.0, mpixels / single_ms * 1000.0, mpixels / threaded_ms * 1000.0,
+				actual == expected ? "yes" : "NO", dxt_rmse(pixels, width, height, channels, &actual[0], (DxtFormat)format));
+		}
+		if (synthetic.empty())
+			SOIL_free_image_data(pixels);
+	}
+}
+
+// Builds the RGBA8 mip chain of each image (a synthetic 4K image by
+// default) with SOIL's mipmap_image(), then with Resampler on one thread and
+// on every hardware thread, for the box filter, the box filter in sRGB, and
+// the Kaiser and Lanczos filters. Reports the time of each chain, the
+// speedup over SOIL, and whether the box chain has SOIL's bytes.
+void bench_mips(const vector<string>& files) {
+	vector<string> names = files;
+	if (names.empty())
+		names.push_back("4096x4096");
+	Resampler single(1);
+	Resampler& threaded = Resampler::instance();
+	char threaded_label[32];
+	sprintf(threaded_label, "x%u ms", (unsigned int)threaded.threads());
+	printf("%-24s %-10s %10s %10s %10s %10s\n", "image", "filter", "x1 ms", threaded_label, "speedup", "identical");
+	for (size_t f = 0; f < names.size(); f++) {
+		int width = 4096, height = 4096, channels = 4;
+		vector<unsigned char> level0;
+		if (files.empty()) {
+			level0.resize((size_t)width * height * 4);
+			for (size_t i = 0; i < level0.size(); i++)
+				level0[i] = (unsigned char)((i * 2654435761u) >> 24) / 4 + (unsigned char)(i / 4 % width / 32);
+		}
+		else {
+			unsigned char* pixels = SOIL_load_image(files[f].c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+			if (pixels == NULL) {
+				printf("Can not load %s\n", files[f].c_str());
+				continue;
+			}
+			level0.assign(pixels, pixels + (size_t)width * height * 4);
+			SOIL_free_image_data(pixels);
+		}
+		// every level one after the other, as DecodedImage keeps them
+		vector<size_t> offsets(1, 0);
+		size_t total = level0.size();
+		for (int level = 1; (width | height) >> level; level++) {
+			offsets.push_back(total);
+			total += (size_t)max(1, width >> level) * max(1, height >> level) * 4;
+		}
+		vector<unsigned char> expected(total);
+		memcpy(&expected[0], &level0[0], level0.size());
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		for (size_t level = 1; level < offsets.size(); level++)
+			mipmap_image(&expected[offsets[level - 1]], max(1, width >> (level - 1)), max(1, height >> (level - 1)), 4, &expected[offsets[level]], 2, 2);
+		double soil_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+		printf("%-24s %-10s %10.1f %10s %10s %10s\n", names[f].c_str(), "SOIL box", soil_ms, "", "", "");
+
+		const char* filter_names[] = { "box", "box srgb", "kaiser", "lanczos" };
+		for (int i = 0; i < 4; i++) {
+			ResampleFilter filter = i < 2 ? RESAMPLE_BOX : (i == 2 ? RESAMPLE_KAISER : RESAMPLE_LANCZOS);
+			bool srgb = i == 1;
+			vector<unsigned char> actual(total);
+			memcpy(&actual[0], &level0[0], level0.size());
+			double ms[2];
+			for (int run = 0; run < 2; run++) {
+				Resampler& resampler = run == 0 ? single : threaded;
+				t0 = chrono::steady_clock::now();
+				for (size_t level = 1; level < offsets.size(); level++)
+					resampler.reduce(&actual[offsets[level - 1]], max(1, width >> (level - 1)), max(1, height >> (level - 1)), false,
+						&actual[offsets[level]], filter, srgb);
+				ms[run] = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+			}
+			printf("%-24s %-10s %10.1f %10.1f %9.1fx %10s\n", "", filter_names[i], ms[0], ms[1], soil_ms / ms[1],
+				i == 0 ? (actual == expected ? "yes" : "NO") : "");
+		}
+	}
+}
+
+// A DDS file loaded the way TextureCache did before it parsed DDS in place:
+// the file hashed, copied whole into gli's storage, flipped when
+// uncompressed, then uploaded level by level from the copy.
+GLuint load_dds_with_gli(const string& path, bool vflip) {
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+	volatile hash64_t key = hash_wide(file.data(), file.size(), 0);
+	(void)key;
+	gli::storage storage = gli::load_dds((const char*)file.data(), file.size());
+	if (storage.empty())
+		return 0;
+	gli::texture2D stored(storage);
+	gli::texture2D texture(vflip && !gli::is_compressed(stored.format()) ? gli::flip(stored) : stored);
+	gli::gl translator;
+	const gli::gl::format& format = translator.translate(texture.format());
+	GLuint id;
+	glCreateTextures(GL_TEXTURE_2D, 1, &id);
+	glTextureStorage2D(id, (GLsizei)texture.levels(), (GLenum)format.Internal, (GLsizei)texture.dimensions().x, (GLsizei)texture.dimensions().y);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (GLsizei level = 0; level < (GLsizei)texture.levels(); level++) {
+		gli::image image = texture[level];
+		if (gli::is_compressed(texture.format()))
+			glCompressedTextureSubImage2D(id, level, 0, 0, (GLsizei)image.dimensions().x, (GLsizei)image.dimensions().y,
+				(GLenum)format.Internal, (GLsizei)image.size(), image.data());
+		else
+			glTextureSubImage2D(id, level, 0, 0, (GLsizei)image.dimensions().x, (GLsizei)image.dimensions().y,
+				(GLenum)format.External, (GLenum)format.Type, image.data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return id;
+}
+
+// Whether two textures hold the same texels in every level, compared as
+// stored for compressed formats.
+bool same_texture(GLuint a, GLuint b) {
+	GLint levels[2];
+	glGetTextureParameteriv(a, GL_TEXTURE_IMMUTABLE_LEVELS, &levels[0]);
+	glGetTextureParameteriv(b, GL_TEXTURE_IMMUTABLE_LEVELS, &levels[1]);
+	if (levels[0] != levels[1])
+		return false;
+	for (GLint level = 0; level < levels[0]; level++) {
+		GLint compressed, size, width, height;
+		glGetTextureLevelParameteriv(a, level, GL_TEXTURE_COMPRESSED, &compressed);
+		glGetTextureLevelParameteriv(a, level, GL_TEXTURE_WIDTH, &width);
+		glGetTextureLevelParameteriv(a, level, GL_TEXTURE_HEIGHT, &height);
+		if (compressed)
+			glGetTextureLevelParameteriv(a, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+		else
+			size = width * height * 16;
+		vector<unsigned char> texels[2] = { vector<unsigned char>(size), vector<unsigned char>(size) };
+		for (int i = 0; i < 2; i++) {
+			if (compressed)
+				glGetCompressedTextureImage(i == 0 ? a : b, level, size, &texels[i][0]);
+			else
+				glGetTextureImage(i == 0 ? a : b, level, GL_RGBA, GL_FLOAT, size, &texels[i][0]);
+		}
+		if (texels[0] != texels[1])
+			return false;
+	}
+	return true;
+}
+
+// Loads the DDS files as one set, in place through TextureCache and then as
+// load_dds_with_gli() does, each cold (the files evicted from the OS cache
+// first) and warm. The textures stay until the whole set is loaded. Reports
+// the time, the file MB/s, the peak memory resident above the start of the
+// run and above its end (what loading needed besides the textures: with a
+// driver that keeps textures in system memory the first includes them), then
+// checks that both paths give the same texels.
+void bench_dds(const vector<string>& files) {
+	TextureSettings settings;
+	TextureCache& cache = TextureCache::instance();
+	cache.disable_streaming();
+	size_t total = 0;
+	for (size_t f = 0; f < files.size(); f++) {
+		MappedFile file;
+		if (file.open(files[f]))
+			total += file.size();
+	}
+	printf("%d files, %.1f MB\n", (int)files.size(), total / 1048576.0);
+	printf("%-10s %-6s %10s %10s %14s %14s\n", "path", "cache", "ms", "MB/s", "peak RSS MB", "transient MB");
+	// in place first: Windows can not reset the peak
+	for (int gli_path = 0; gli_path < 2; gli_path++) {
+		for (int warm = 0; warm < 2; warm++) {
+			if (!warm)
+				for (size_t f = 0; f < files.size(); f++)
+					evict_file_cache(files[f]);
+			vector<GLuint> textures;
+			reset_peak_resident();
+			size_t base = resident_bytes();
+			chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+			for (size_t f = 0; f < files.size(); f++)
+				textures.push_back(gli_path ? load_dds_with_gli(files[f], settings.vflip) : cache.acquire(files[f], settings));
+			glFinish();
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+			size_t peak = peak_resident_bytes(), loaded = resident_bytes();
+			for (size_t f = 0; f < textures.size(); f++) {
+				if (gli_path)
+					glDeleteTextures(1, &textures[f]);
+				else if (textures[f])
+					cache.release(textures[f]);
+			}
+			printf("%-10s %-6s %10.1f %10.1f %14.1f %14.1f\n", gli_path ? "gli copy" : "in place", warm ? "warm" : "cold", ms,
+				total / 1048576.0 / (ms / 1000.0), (peak > base ? peak - base : 0) / 1048576.0, (peak > loaded ? peak - loaded : 0) / 1048576.0);
+		}
+	}
+	for (size_t f = 0; f < files.size(); f++) {
+		GLuint in_place = cache.acquire(files[f], settings);
+		GLuint copied = load_dds_with_gli(files[f], settings.vflip);
+		printf("%s: %s\n", files[f].c_str(), in_place && copied ? (same_texture(in_place, copied) ? "same texels" : "DIFFERS") : "not loaded");
+		if (in_place)
+			cache.release(in_place);
+		glDeleteTextures(1, &copied);
+	}
+}
+
+// ShaderToy iMouse: xy is the position while the left button is down, zw the
+// position of the last click, negated while the button is up.
+void update_mouse(vec4& iMouse) {
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	y = HEIGHT - y;
+	bool down = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	bool was_down = iMouse.z > 0.0f;
+	if (down) {
+		if (!was_down)
+			iMouse = vec4(x, y, x, y);
+		iMouse.x = (float)x;
+		iMouse.y = (float)y;
+	}
+	else if (was_down) {
+		iMouse.z = -iMouse.z;
+		iMouse.w = -iMouse.w;
+	}
+}
+
+// Edge-triggered keys of the player: pressed() is true on the frame a key
+// goes down.
+struct PlaybackKeys
+{
+	bool down[GLFW_KEY_LAST + 1];
+
+	PlaybackKeys()
+	{
+		memset(down, 0, sizeof(down));
+	}
+
+	bool pressed(int key)
+	{
+		bool now = glfwGetKey(window, key) == GLFW_PRESS;
+		bool was = down[key];
+		down[key] = now;
+		return now && !was;
+	}
+};
+
+// ShaderToy iDate: year, month (0-11), day of month, seconds since midnight.
+vec4 current_date() {
+	time_t now = time(NULL);
+	struct tm* t = localtime(&now);
+	return vec4(t->tm_year + 1900, t->tm_mon, t->tm_mday, t->tm_hour * 3600 + t->tm_min * 60 + t->tm_sec);
+}
+
+// Command line of the offline renderer; see README.md for the flags.
+struct RenderOptions
+{
+	bool headless = false;
+	bool bench_capture = false;
+	bool still = false;
+	int still_width = 0;
+	int still_height = 0;
+	int tile = 1024;
+	double dynamic_ms = 0.0;		// frame budget of dynamic resolution, 0 = off
+	float sharpness = 0.0f;
+	int interleave = 1;				// shade 1/N of the pixels per frame
+	int first_frame = 0;
+	int last_frame = 0;
+	float fps = 60.0f;
+	bool fixed_step = false;		// interactive iTime advances 1/fps per frame
+	double start = 0.0;				// interactive iTime of the first frame
+	int swap_interval = 1;			// 0 = no vsync, -1 = adaptive
+	int frames_in_flight = 2;		// 0 = as many as the driver queues
+	double texture_budget = 1.0;	// MB of streamed texture uploads per frame
+	string channels[4];				// iChannel images of single-shader entries
+	int width = WIDTH;
+	int height = HEIGHT;
+	string out = "frame_%04d.tga";
+};
+
+// Splits argv into options and playlist entries. Returns false on a
+// malformed option.
+bool parse_options(int argc, char** argv, RenderOptions& options, vector<string>& playlist) {
+	bool out_given = false;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--headless") == 0)
+			options.headless = true;
+		else if (strcmp(arg, "--bench-capture") == 0) {
+			options.headless = true;
+			options.bench_capture = true;
+			if (options.last_frame == 0)
+				options.last_frame = 239;
+		}
+		else if (strcmp(arg, "--frames") == 0 && i + 2 < argc) {
+			options.first_frame = atoi(argv[++i]);
+			options.last_frame = atoi(argv[++i]);
+			if (options.first_frame < 0 || options.last_frame < options.first_frame) {
+				printf("--frames expects 0 <= first <= last\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--fps") == 0 && has_value) {
+			options.fps = (float)atof(argv[++i]);
+			if (options.fps <= 0.0f) {
+				printf("--fps expects a positive frame rate\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--size") == 0 && has_value) {
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 ||
+				options.width <= 0 || options.height <= 0) {
+				printf("--size expects WIDTHxHEIGHT\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--still") == 0 && has_value) {
+			options.headless = true;
+			options.still = true;
+			if (sscanf(argv[++i], "%dx%d", &options.still_width, &options.still_height) != 2 ||
+				options.still_width <= 0 || options.still_height <= 0) {
+				printf("--still expects WIDTHxHEIGHT\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--tile") == 0 && has_value) {
+			options.tile = atoi(argv[++i]);
+			if (options.tile <= 0) {
+				printf("--tile expects a positive size\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--dynamic-resolution") == 0 && has_value) {
+			options.dynamic_ms = atof(argv[++i]);
+			if (options.dynamic_ms <= 0.0) {
+				printf("--dynamic-resolution expects a frame budget in ms\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--interleave") == 0 && has_value) {
+			options.interleave = atoi(argv[++i]);
+			if (options.interleave < 1 || options.interleave > 8) {
+				printf("--interleave expects 1 to 8\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--fixed-step") == 0)
+			options.fixed_step = true;
+		else if (strcmp(arg, "--start") == 0 && has_value) {
+			options.start = atof(argv[++i]);
+			if (options.start < 0.0) {
+				printf("--start expects seconds >= 0\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--swap-interval") == 0 && has_value)
+			options.swap_interval = atoi(argv[++i]);
+		else if (strcmp(arg, "--frames-in-flight") == 0 && has_value) {
+			options.frames_in_flight = atoi(argv[++i]);
+			if (options.frames_in_flight < 0 || options.frames_in_flight > FramePacer::MAX_FRAMES) {
+				printf("--frames-in-flight expects 0 to %d\n", FramePacer::MAX_FRAMES);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--texture-budget") == 0 && has_value) {
+			options.texture_budget = atof(argv[++i]);
+			if (options.texture_budget <= 0.0) {
+				printf("--texture-budget expects MB > 0\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--channel") == 0 && i + 2 < argc) {
+			int channel = atoi(argv[++i]);
+			if (channel < 0 || channel > 3) {
+				printf("--channel expects 0 to 3\n");
+				return false;
+			}
+			options.channels[channel] = argv[++i];
+		}
+		else if (strcmp(arg, "--sharpen") == 0 && has_value)
+			options.sharpness = (float)glm::clamp(atof(argv[++i]), 0.0, 1.0);
+		else if (strcmp(arg, "--out") == 0 && has_value) {
+			options.out = argv[++i];
+			out_given = true;
+		}
+		else if (strncmp(arg, "--", 2) == 0) {
+			printf("Unknown or incomplete option %s\n", arg);
+			return false;
+		}
+		else
+			playlist.push_back(arg);
+	}
+	if (options.still && !out_given)
+		options.out = "still_%04d.ppm";
+	return true;
+}
+
+// channels are --channel images for an entry that is a single shader; a
+// .graph names its own.
+bool load_graph(RenderGraph& graph, const char* vert_path, const string& entry, int width, int height, const string* channels) {
+	graph.set_vertex_shader(vert_path);
+	bool ok;
+	if (entry.size() > 6 && entry.compare(entry.size() - 6, 6, ".graph") == 0)
+		ok = graph.load(entry);
+	else {
+		graph.set_pass(PASS_IMAGE, entry);
+		ok = true;
+		for (int c = 0; c < 4 && ok; c++)
+			if (!channels[c].empty())
+				ok = graph.set_channel_token(PASS_IMAGE, c, channels[c], "");
+	}
+	return ok && graph.build(width, height);
+}
+
+enum CaptureMode { CAPTURE_NONE, CAPTURE_SYNC, CAPTURE_ASYNC };
+
+// Reads the frame back with a blocking glReadPixels and encodes it on the
+// render thread. Only kept as the baseline for --bench-capture.
+bool save_frame_sync(GLuint framebuffer, int width, int height, const string& pattern, int frame) {
+	int save_type = SOIL_SAVE_TYPE_TGA;
+	size_t dot = pattern.rfind('.');
+	if (dot != string::npos && pattern.compare(dot, string::npos, ".bmp") == 0)
+		save_type = SOIL_SAVE_TYPE_BMP;
+	int row_bytes = width * 3;
+	vector<unsigned char> pixels(row_bytes * height);
+	vector<unsigned char> row(row_bytes);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	// GL rows start at the bottom, image files at the top
+	for (int y = 0; y < height / 2; y++) {
+		unsigned char* a = &pixels[y * row_bytes];
+		unsigned char* b = &pixels[(height - 1 - y) * row_bytes];
+		memcpy(&row[0], a, row_bytes);
+		memcpy(a, b, row_bytes);
+		memcpy(b, &row[0], row_bytes);
+	}
+	char path[1024];
+	snprintf(path, sizeof(path), pattern.c_str(), frame);
+	if (!SOIL_save_image(path, save_type, width, height, 3, &pixels[0])) {
+		printf("Can not write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+// Inputs of an offline render: everything but iTime and iFrame is constant.
+ShaderToyInputs fixed_timeline_inputs(const RenderOptions& options) {
+	ShaderToyInputs inputs = {};
+	inputs.iResolution = vec3(options.width, options.height, 0);
+	inputs.iSampleRate = 44100.0f;
+	inputs.iTimeDelta = 1.0f / options.fps;
+	inputs.iFrameRate = options.fps;
+	// a fixed date keeps iDate-driven shaders reproducible too
+	inputs.iDate = vec4(2000, 0, 1, 0);
+	return inputs;
+}
+
+// Renders frames [first_frame, last_frame] on a fixed timeline
+// (iTime = frame / fps). Graphs with feedback buffers are stepped through the
+// frames before first_frame without capturing them. Returns the frames per
+// second achieved, including the time to get every capture written, or a
+// negative value when a frame could not be saved.
+double render_sequence(RenderGraph& graph, FullscreenTriangle& quad, RenderTarget& target, const RenderOptions& options, CaptureMode mode,
+	GpuTimer& timer, InterleavedRenderer* interleaver) {
+	ShaderToyInputsRing inputs_ring;
+	inputs_ring.init();
+	ShaderToyInputs inputs = fixed_timeline_inputs(options);
+
+	FrameCapture capture;
+	if (mode == CAPTURE_ASYNC && !capture.init(options.width, options.height, options.out))
+		return -1.0;
+	int start = graph.has_feedback() ? 0 : options.first_frame;
+	bool ok = true;
+	// no GLFW under EGL, so time with the standard clock
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	for (int frame = start; frame <= options.last_frame && ok; frame++) {
+		inputs.iFrame = frame;
+		inputs.iTime = frame / options.fps;
+		timer.begin_frame();
+		inputs_ring.upload(inputs);
+		if (interleaver)
+			interleaver->begin_frame(graph, frame);
+		graph.render(quad);
+		if (interleaver)
+			interleaver->resolve(quad, target.framebuffer());
+		inputs_ring.end_frame();
+		timer.end_frame();
+		if (frame < options.first_frame)
+			continue;
+		if (mode == CAPTURE_SYNC)
+			ok = save_frame_sync(target.framebuffer(), options.width, options.height, options.out, frame);
+		else if (mode == CAPTURE_ASYNC)
+			capture.capture(target.framebuffer(), frame);
+	}
+	capture.flush();
+	glFinish();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	timer.collect();
+	if (mode == CAPTURE_ASYNC) {
+		capture.print_stats();
+		ok = ok && capture.stats().failed == 0;
+	}
+	if (!ok)
+		return -1.0;
+	int frames = options.last_frame - start + 1;
+	return seconds > 0.0 ? frames / seconds : 0.0;
+}
+
+// Renders one playlist entry offscreen and writes every frame to an image, so
+// the same command always produces the same files. With --bench-capture the frame
+// range is rendered three times instead: without capture, with the blocking
+// readback and with the asynchronous capture ring.
+int run_headless(const RenderOptions& options, const char* vert_path, const string& entry) {
+	HeadlessContext context;
+	if (!context.init())
+		return -1;
+	int result = 0;
+	{
+		FullscreenTriangle quad;
+		quad.init();
+		// a still is drawn in tiles, and the graph only ever sees one tile
+		int width = options.width;
+		int height = options.height;
+		if (options.still) {
+			width = height = max_tile_size(options.tile);
+			width = min(width, options.still_width);
+			height = min(height, options.still_height);
+		}
+		RenderGraph graph;
+		graph.set_frag_coord_remap(options.still || options.interleave > 1);
+		if (!load_graph(graph, vert_path, entry, width, height, options.channels))
+			return -1;
+		RenderTarget target;
+		target.init(width, height);
+		graph.set_output(target.framebuffer());
+		GpuTimer timer;
+		if (!options.still)
+			graph.set_timer(&timer);
+		if (!graph.wait_ready()) {
+			printf("Failed to build %s\n", entry.c_str());
+			return -1;
+		}
+		InterleavedRenderer interleaved;
+		InterleavedRenderer* interleaver = NULL;
+		if (options.interleave > 1 && !options.still) {
+			if (!interleaved.init(width, height, options.interleave) || !interleaved.attach(graph))
+				return -1;
+			interleaver = &interleaved;
+		}
+
+		int frames = options.last_frame - options.first_frame + 1;
+		if (options.still) {
+			ShaderToyInputs inputs = fixed_timeline_inputs(options);
+			inputs.iFrame = options.first_frame;
+			inputs.iTime = options.first_frame / options.fps;
+			char path[1024];
+			snprintf(path, sizeof(path), options.out.c_str(), options.first_frame);
+			printf("rendering %dx%d still in %dx%d tiles\n", options.still_width, options.still_height, width, height);
+			if (!render_tiled_still(graph, quad, target, inputs, options.still_width, options.still_height, path))
+				result = -1;
+		}
+		else if (options.bench_capture) {
+			double render_fps = render_sequence(graph, quad, target, options, CAPTURE_NONE, timer, interleaver);
+			double sync_fps = render_sequence(graph, quad, target, options, CAPTURE_SYNC, timer, interleaver);
+			double async_fps = render_sequence(graph, quad, target, options, CAPTURE_ASYNC, timer, interleaver);
+			printf("capture, %d frames at %dx%d\n", frames, options.width, options.height);
+			printf("  render only:      %8.1f fps\n", render_fps);
+			printf("  glReadPixels:     %8.1f fps\n", sync_fps);
+			printf("  PBO ring + pool:  %8.1f fps\n", async_fps);
+			result = sync_fps < 0.0 || async_fps < 0.0 ? -1 : 0;
+		}
+		else {
+			double fps = render_sequence(graph, quad, target, options, CAPTURE_ASYNC, timer, interleaver);
+			if (fps < 0.0)
+				result = -1;
+			else
+				printf("rendered %d frames at %dx%d, %.1f fps\n", frames, options.width, options.height, fps);
+			timer.print_summary();
+		}
+	}
+	ProgramCache::instance().print_stats();
+	TextureCache::instance().print_stats();
+	return result;
+}
+
 int main(int argc, char **argv)
 {
+	chrono::steady_clock::time_point launch = chrono::steady_clock::now();
+	const char* vert_path = "shader/fullscreen_vert.glsl";
+	//const char* frag_path = "shader/fire_ball_frag.glsl";
+	const char* frag_path = "shader/unreal_intro_frag.glsl";
+	// Every fragment shader (single Image pass) or .graph file (multipass)
+	// given on the command line forms the playlist; all of them compile
+	// concurrently while the window keeps drawing.
+	RenderOptions options;
+	vector<string> playlist;
+	bool bench = argc > 1 && strcmp(argv[1], "--bench-uniforms") == 0;
+	bool bench_draws = argc > 1 && strcmp(argv[1], "--bench-models") == 0;
+	bool bench_loader = argc > 1 && strcmp(argv[1], "--bench-assets") == 0;
+	bool bench_meshes = argc > 1 && strcmp(argv[1], "--bench-optimize") == 0;
+	bool bench_batches = argc > 1 && strcmp(argv[1], "--bench-instances") == 0;
+	bool bench_streaming = argc > 1 && strcmp(argv[1], "--bench-textures") == 0;
+	bool bench_compression = argc > 1 && strcmp(argv[1], "--bench-dxt") == 0;
+	bool bench_resampling = argc > 1 && strcmp(argv[1], "--bench-mips") == 0;
+	bool bench_containers = argc > 1 && strcmp(argv[1], "--bench-dds") == 0;
+	if (!bench && !bench_draws && !bench_loader && !bench_meshes && !bench_batches && !bench_streaming && !bench_compression
+		&& !bench_resampling && !bench_containers && !parse_options(argc, argv, options, playlist))
+		return -1;
+	if (playlist.empty()) {
+		playlist.push_back(frag_path);
+		playlist.push_back("shader/fire_ball_frag.glsl");
+	}
+	if (options.headless)
+		return run_headless(options, vert_path, playlist[0]);
+
 	cout << "init opengl and window context....." << endl;
 	init_glfw_glew();
 	cout << "init success" << endl;
+	double context_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - launch).count();
 	glClearColor(0.4f, 0.8f, 0.6f, 0.0f);
-	Model quad;
-	quad.init("quad.obj", false, true, false, false);
-	Shader shader;
-	//shader.init("shader/main_vert.glsl", "shader/fire_ball_frag.glsl");
-	shader.init("shader/main_vert.glsl", "shader/unreal_intro_frag.glsl");
+	FullscreenTriangle quad;
+	quad.init();
 	vec3 iResolution = vec3(WIDTH, HEIGHT, 0);
-	clock_t start_time = clock();
-	clock_t curr_time;
-	float playtime_in_second = 0;
+	if (bench_streaming) {
+		bench_textures(argc > 2 ? max(0.0625, atof(argv[2])) : 1.0, vector<string>(argv + min(argc, 3), argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_compression) {
+		bench_dxt(vector<string>(argv + 2, argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_resampling) {
+		bench_mips(vector<string>(argv + 2, argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_containers) {
+		bench_dds(vector<string>(argv + 2, argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_batches) {
+		bench_instances(argc > 2 ? max(1, atoi(argv[2])) : 10000, vector<string>(argv + min(argc, 3), argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_meshes) {
+		bench_optimize(vector<string>(argv + 2, argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_loader) {
+		bench_assets(vector<string>(argv + 2, argv + argc));
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_draws) {
+		bench_models("shader/main_vert.glsl", frag_path, argc > 2 ? max(1, atoi(argv[2])) : 1000, argc > 3 ? argv[3] : "quad.obj");
+		quad.destory();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench) {
+		bench_uniforms(vert_path, frag_path, iResolution);
+		glfwTerminate();
+		return 0;
+	}
+	Shader::enable_parallel_compile();
+	// iChannel images decode in the background and upload over a few frames
+	TextureCache::instance().enable_streaming((size_t)(options.texture_budget * 1024 * 1024));
+	vector<unique_ptr<RenderGraph>> graphs;
+	for (size_t i = 0; i < playlist.size(); i++) {
+		unique_ptr<RenderGraph> graph(new RenderGraph());
+		graph->set_frag_coord_remap(options.interleave > 1);
+		if (load_graph(*graph, vert_path, playlist[i], WIDTH, HEIGHT, options.channels))
+			graphs.push_back(move(graph));
+	}
+	if (graphs.empty()) {
+		TextureCache::instance().disable_streaming();
+		glfwTerminate();
+		return -1;
+	}
+	size_t current = 0;
+	// Hot-reload: edits to any source or include of a shader rebuild it in the
+	// background; the old program keeps running until the new one links.
+	FileWatcher watcher;
+	vector<Shader*> shaders;
+	for (size_t i = 0; i < graphs.size(); i++) {
+		vector<Shader*> pass_shaders = graphs[i]->shaders();
+		shaders.insert(shaders.end(), pass_shaders.begin(), pass_shaders.end());
+	}
+	for (size_t i = 0; i < shaders.size(); i++)
+		for (size_t d = 0; d < shaders[i]->dependencies().size(); d++)
+			watcher.watch_file(shaders[i]->dependencies()[d]);
+	ShaderToyInputsRing inputs_ring;
+	inputs_ring.init();
+	ShaderToyInputs inputs = {};
+	inputs.iResolution = iResolution;
+	inputs.iSampleRate = 44100.0f;
+	GpuTimer timer;
+	for (size_t i = 0; i < graphs.size(); i++)
+		graphs[i]->set_timer(&timer);
+	// Dynamic resolution: the graph renders at a scale chosen from the GPU
+	// frame time and is upscaled to the window.
+	DynamicResolution dynres;
+	bool dynamic = options.dynamic_ms > 0.0;
+	if (dynamic) {
+		DynamicResolutionSettings settings;
+		settings.target_ms = options.dynamic_ms;
+		if (!dynres.init(WIDTH, HEIGHT, settings, options.sharpness)) {
+			printf("Dynamic resolution unavailable, rendering at full size\n");
+			dynamic = false;
+		}
+		else
+			dynres.attach(*graphs[current]);
+	}
+	// Interleaved rendering: single-pass shaders run for 1/N of the pixels
+	// each frame and a resolve pass fills in the rest from history.
+	InterleavedRenderer interleaver;
+	bool interleave = options.interleave > 1;
+	if (interleave && dynamic) {
+		printf("--interleave and --dynamic-resolution don't combine, rendering interleaved only\n");
+		dynamic = false;
+		graphs[current]->set_output(0);
+		graphs[current]->resize(WIDTH, HEIGHT);
+	}
+	if (interleave && !interleaver.init(WIDTH, HEIGHT, options.interleave)) {
+		printf("Interleaved rendering unavailable, rendering every pixel\n");
+		interleave = false;
+	}
+	bool interleaved = interleave && interleaver.attach(*graphs[current]);
+	bool started = false;
+	unsigned int frame_samples = 0;
+	vec4 mouse = vec4(0.0f);
+	// Playback: space pauses, Home restarts, Page Up/Down seek 5 s. With
+	// --fixed-step every frame advances 1/fps.
+	FrameClock clock;
+	if (options.fixed_step)
+		clock.set_fixed_step(1.0 / options.fps);
+	clock.seek(options.start);
+	glfwSwapInterval(options.swap_interval);
+	FramePacer pacer;
+	pacer.init(options.frames_in_flight);
+	PlaybackKeys keys;
+	int rendered = 0;				// keeps counting while paused
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 		glfwWindowShouldClose(window) == 0) {
+		pacer.wait();
+		glfwPollEvents();
+		if (keys.pressed(GLFW_KEY_SPACE))
+			clock.set_paused(!clock.paused());
+		if (keys.pressed(GLFW_KEY_HOME)) {
+			clock.restart();
+			graphs[current]->clear_feedback();
+			interleaver.reset();
+		}
+		if (keys.pressed(GLFW_KEY_PAGE_UP))
+			clock.seek(clock.time() + 5.0);
+		if (keys.pressed(GLFW_KEY_PAGE_DOWN))
+			clock.seek(clock.time() - 5.0);
+		clock.tick();
+		timer.begin_frame();
 		glClear(GL_COLOR_BUFFER_BIT);
-		curr_time = clock();
-		playtime_in_second = (curr_time - start_time)*1.0f / 1000.0f;
-		//cout << "playtime_in_second = " << playtime_in_second << endl;
-		shader.use();
-		shader.bind_vec3("iResolution", iResolution);
-		shader.bind_float("iTime",playtime_in_second);
-		quad.render();
+		inputs.iTime = (float)clock.time();
+		inputs.iTimeDelta = (float)clock.delta();
+		inputs.iFrame = clock.frame();
+		inputs.iFrameRate = (float)clock.frame_rate();
+		inputs.iDate = current_date();
+		update_mouse(mouse);
+		inputs.iMouse = mouse;
+		if (dynamic) {
+			// shaders see the internal resolution, pixel coordinates included
+			glm::ivec2 size = dynres.internal_size();
+			inputs.iResolution = vec3(size.x, size.y, 0);
+			inputs.iMouse = mouse * dynres.scale();
+		}
+		inputs_ring.upload(inputs);
+		TextureCache::instance().update();
+		if (watcher.has_changes()) {
+			vector<string> changed = watcher.take_changes();
+			for (size_t i = 0; i < shaders.size(); i++) {
+				for (size_t c = 0; c < changed.size(); c++) {
+					if (shaders[i]->depends_on(changed[c])) {
+						printf("reloading %s\n", changed[c].c_str());
+						shaders[i]->reload();
+						interleaver.reset();
+						for (size_t d = 0; d < shaders[i]->dependencies().size(); d++)
+							watcher.watch_file(shaders[i]->dependencies()[d]);
+						break;
+					}
+				}
+			}
+		}
+		// right arrow: next entry in the playlist
+		if (keys.pressed(GLFW_KEY_RIGHT)) {
+			current = (current + 1) % graphs.size();
+			if (dynamic)
+				dynres.attach(*graphs[current]);
+			if (interleave)
+				interleaved = interleaver.attach(*graphs[current]);
+		}
+		if (interleaved)
+			interleaver.begin_frame(*graphs[current], rendered);
+		graphs[current]->render(quad);
+		if (dynamic)
+			dynres.present(quad);
+		if (interleaved)
+			interleaver.resolve(quad);
+		inputs_ring.end_frame();
+		timer.end_frame();
+		if (dynamic && timer.total_samples(0) != frame_samples) {
+			frame_samples = timer.total_samples(0);
+			if (dynres.update(timer.latest_ms(0))) {
+				dynres.attach(*graphs[current]);
+				glm::ivec2 size = dynres.internal_size();
+				printf("render scale %.2f (%dx%d)\n", dynres.scale(), size.x, size.y);
+			}
+		}
+
+		rendered++;
 
 		glfwSwapBuffers(window);
-		glfwPollEvents();
+		pacer.end_frame();
+		if (!started && graphs[current]->ready()) {
+			// launch to the first frame that ran the shader
+			double startup_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - launch).count();
+			printf("startup %.1f ms (context %.1f ms)\n", startup_ms, context_ms);
+			started = true;
+		}
 	}
+	timer.collect();
+	timer.print_summary();
+	pacer.print_summary();
+	pacer.destory();
+	timer.destory();
+	dynres.destory();
+	interleaver.destory();
+	quad.destory();
+	ProgramCache::instance().print_stats();
+	TextureCache::instance().print_stats();
+	TextureCache::instance().disable_streaming();
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 330 core
+// Fullscreen triangle without vertex attributes; draw 3 vertices with an
+// empty VAO. texcoord runs 0..1 across the viewport.
+out vec2 texcoord;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texcoord = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 430 core
+// Shades each instance with the colour in its params, darkened across uv.
+in vec2 texcoord;
+flat in vec4 instance_params;
+
+out vec4 color;
+
+void main()
+{
+    color = vec4(instance_params.rgb * (0.5 + 0.5 * texcoord.x), 1.0);
+}
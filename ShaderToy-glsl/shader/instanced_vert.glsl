@@ -0,0 +1,30 @@
+#version 430 core
+// Vertex shader for InstanceBatch: a MeshArena built with uv and without
+// normal (position at location 0, uv at 1), one InstanceData per instance.
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec2 in_texcoord;
+layout (location = 7) in uint in_instance;
+
+struct Instance
+{
+    mat4 transform;
+    vec4 params;
+};
+
+layout (std430, binding = 1) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+uniform mat4 view_projection;
+
+out vec2 texcoord;
+flat out vec4 instance_params;
+
+void main()
+{
+    Instance instance = instances[in_instance];
+    gl_Position = view_projection * instance.transform * vec4(in_position, 1.0);
+    texcoord = in_texcoord;
+    instance_params = instance.params;
+}
@@ -0,0 +1,65 @@
+#version 330 core
+// Rebuilds a full frame from an interleaved one. current holds this frame's
+// shaded pixels, every Nth pixel of each row starting at column
+// (y + phase) % N, packed into a 1/N-wide texture. Pixels shaded this frame
+// are copied; the others come from history, the previous resolved frame,
+// clamped to the range of the freshly shaded pixels around them so stale
+// values can't ghost far.
+out vec4 color;
+
+uniform sampler2D current;
+uniform sampler2D history;
+uniform vec2 interleave;		// x: N, y: phase of this frame
+uniform bool has_history;		// false right after a reset
+
+vec3 fetch_current(int cx, int y)
+{
+	ivec2 size = textureSize(current, 0);
+	return texelFetch(current, clamp(ivec2(cx, y), ivec2(0), size - 1), 0).rgb;
+}
+
+// Column of row y's shaded pixel at or left of x, in current's coordinates.
+int packed_column(int x, int y, int n, int phase)
+{
+	int k = x - (y + phase) % n;
+	return k >= 0 ? k / n : -1;
+}
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	int n = int(interleave.x);
+	int phase = int(interleave.y);
+	int k = p.x - (p.y + phase) % n;
+	if (k >= 0 && k % n == 0) {
+		color = vec4(fetch_current(k / n, p.y), 1.0);
+		return;
+	}
+
+	// shaded neighbours: left and right in this row, and around x in the
+	// rows above and below
+	int cx = packed_column(p.x, p.y, n, phase);
+	vec3 left = fetch_current(cx, p.y);
+	vec3 right = fetch_current(cx + 1, p.y);
+	vec3 lo = min(left, right);
+	vec3 hi = max(left, right);
+	int last_row = textureSize(current, 0).y - 1;
+	for (int dy = -1; dy <= 1; dy += 2) {
+		// clamped first: packed_column's % is undefined for a negative row
+		int y = clamp(p.y + dy, 0, last_row);
+		int c = packed_column(p.x, y, n, phase);
+		vec3 a = fetch_current(c, y);
+		vec3 b = fetch_current(c + 1, y);
+		lo = min(lo, min(a, b));
+		hi = max(hi, max(a, b));
+	}
+
+	if (has_history) {
+		vec3 previous = texelFetch(history, p, 0).rgb;
+		color = vec4(clamp(previous, lo, hi), 1.0);
+	}
+	else {
+		float t = float(k - cx * n) / float(n);
+		color = vec4(mix(left, right, t), 1.0);
+	}
+}
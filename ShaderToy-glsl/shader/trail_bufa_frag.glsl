@@ -0,0 +1,23 @@
+#version 330 core
+uniform vec3 iResolution;
+uniform float iTime;
+uniform vec4 iMouse;
+uniform sampler2D iChannel0;
+in vec2 texcoord;
+layout(location = 0) out vec4 fragColor;
+
+// Buffer A: previous frame (iChannel0) faded out, plus a light that follows
+// the mouse while the button is down and a Lissajous curve otherwise.
+void main(){
+	vec2 uv = gl_FragCoord.xy / iResolution.xy;
+	vec2 p = (gl_FragCoord.xy - 0.5 * iResolution.xy) / iResolution.y;
+
+	vec2 light = vec2(0.6 * sin(iTime * 1.3), 0.4 * sin(iTime * 2.1));
+	if (iMouse.z > 0.0)
+		light = (iMouse.xy - 0.5 * iResolution.xy) / iResolution.y;
+
+	vec3 col = 0.97 * texture(iChannel0, uv).rgb;
+	vec3 tint = 0.5 + 0.5 * cos(iTime + vec3(0.0, 2.0, 4.0));
+	col += tint * 0.004 / (dot(p - light, p - light) + 0.001);
+	fragColor = vec4(col, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+uniform vec3 iResolution;
+uniform sampler2D iChannel0;
+in vec2 texcoord;
+layout(location = 0) out vec4 fragColor;
+
+// Image: tone-map Buffer A.
+void main(){
+	vec3 col = texture(iChannel0, gl_FragCoord.xy / iResolution.xy).rgb;
+	col = col / (1.0 + col);
+	fragColor = vec4(pow(col, vec3(1.0 / 2.2)), 1.0);
+}
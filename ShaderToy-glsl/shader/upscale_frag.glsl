@@ -0,0 +1,31 @@
+#version 330 core
+// Upscales the lower-left uv_scale part of source to the whole target.
+// sharpness 0 is plain bilinear; above that a contrast-adaptive sharpen
+// restores edges the bilinear filter softened, backing off where the local
+// contrast is already high so edges don't ring.
+in vec2 texcoord;
+out vec4 color;
+
+uniform sampler2D source;
+uniform vec2 uv_scale;		// rendered size / texture size
+uniform vec2 texel;			// 1 / texture size
+uniform float sharpness;
+
+void main()
+{
+	// stay half a texel inside the rendered area, the rest is stale
+	vec2 uv = clamp(texcoord * uv_scale, 0.5 * texel, uv_scale - 0.5 * texel);
+	vec3 c = texture(source, uv).rgb;
+	if (sharpness > 0.0) {
+		vec3 n = texture(source, uv + vec2(0.0, texel.y)).rgb;
+		vec3 s = texture(source, uv - vec2(0.0, texel.y)).rgb;
+		vec3 e = texture(source, uv + vec2(texel.x, 0.0)).rgb;
+		vec3 w = texture(source, uv - vec2(texel.x, 0.0)).rgb;
+		vec3 lo = min(c, min(min(n, s), min(e, w)));
+		vec3 hi = max(c, max(max(n, s), max(e, w)));
+		vec3 amount = sqrt(clamp(min(lo, 2.0 - hi) / max(hi, vec3(1e-4)), 0.0, 1.0));
+		vec3 weight = -amount * mix(0.125, 0.2, sharpness);
+		c = clamp((c + weight * (n + s + e + w)) / (1.0 + 4.0 * weight), 0.0, 1.0);
+	}
+	color = vec4(c, 1.0);
+}